@@ -0,0 +1,142 @@
+/*!
+ * @file benchmark.cpp
+ * @author janwolzenburg
+ * @brief Throughput and latency benchmark of WiFiStation and lwIP
+ * @details Connects to WIFI_SSID and runs all benchmark modes against a server at BENCHMARK_SERVER_IP.
+ *          The server can be the host build of the benchmark or a second Pico running this program without server address
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "wiFiStation.h"
+#include "networkBenchmark.h"
+
+
+#ifndef WIFI_SSID
+#error "WIFI_SSID must be defined"
+#endif
+
+#ifndef WIFI_PASSWORD
+#define WIFI_PASSWORD ""
+#endif
+
+
+/*!
+ * @brief Clock for benchmark
+ *
+ * @return uint64_t Microseconds since boot
+ */
+static uint64_t clockUs( void ){
+    return time_us_64();
+}
+
+
+/*!
+ * @brief Poll WiFi and feed watchdog
+ *
+ */
+static void service( void ){
+    #ifdef USE_POLLING
+    WiFiStation::poll();
+    #elif defined( USE_WATCHDOG )
+    WiFiStation::updateWatchdog();
+    #endif
+}
+
+
+int main( void ){
+
+    stdio_init_all();
+
+    if( WiFiStation::initialise() != 0 ){
+        printf( "WiFi initialisation failed\r\n" );
+        return -1;
+    }
+
+    // Open network when no password is given
+    const uint32_t authentification = string{ WIFI_PASSWORD }.empty() ? CYW43_AUTH_OPEN : CYW43_AUTH_WPA2_MIXED_PSK;
+    WiFiStation station{ WIFI_SSID, WIFI_PASSWORD, authentification };
+
+    station.connect();
+
+    #ifdef USE_WATCHDOG
+    WiFiStation::startWatchdog();
+    #endif
+
+    // Wait for connection
+    while( !station.connected() ){
+        service();
+    }
+
+    printf( "Connected. IP: %s\r\n", ip4addr_ntoa( netif_ip4_addr( &cyw43_state.netif[CYW43_ITF_STA] ) ) );
+
+    NetworkBenchmark benchmark{ clockUs };
+
+    #ifndef BENCHMARK_SERVER_IP
+
+    // Act as server for a peer
+    benchmark.startServer();
+    printf( "Benchmark server listening on port %u\r\n", NetworkBenchmark::default_port );
+
+    uint64_t last_report = time_us_64();
+    uint64_t last_bytes = 0;
+
+    while( true ){
+        service();
+
+        if( time_us_64() - last_report >= 1000000 ){
+            const uint64_t bytes = benchmark.serverBytes();
+            printf( "benchmark server bytes=%llu kbit_s=%llu packets=%lu\r\n",
+                    static_cast<unsigned long long>( bytes ), static_cast<unsigned long long>( ( bytes - last_bytes ) * 8 / 1000 ),
+                    static_cast<unsigned long>( benchmark.serverPackets() ) );
+            last_bytes = bytes;
+            last_report = time_us_64();
+        }
+    }
+
+    #else
+
+    NetworkBenchmark::Configuration configuration{};
+    ipaddr_aton( BENCHMARK_SERVER_IP, &configuration.server );
+
+    const NetworkBenchmark::Mode modes[] = {
+        NetworkBenchmark::Mode::tcp_throughput,
+        NetworkBenchmark::Mode::udp_throughput,
+        NetworkBenchmark::Mode::tcp_latency,
+        NetworkBenchmark::Mode::udp_latency
+    };
+
+    for( const auto mode : modes ){
+        configuration.mode = mode;
+
+        // Small requests for latency, full segments for throughput
+        configuration.payload_size = ( mode == NetworkBenchmark::Mode::tcp_latency || mode == NetworkBenchmark::Mode::udp_latency ) ?
+                                     32 : NetworkBenchmark::max_payload_size;
+
+        if( benchmark.start( configuration ) != 0 ){
+            continue;
+        }
+
+        while( benchmark.isRunning() ){
+            service();
+            benchmark.update();
+        }
+
+        NetworkBenchmark::printResult( benchmark.result() );
+    }
+
+    printf( "Benchmark finished\r\n" );
+
+    while( true ){
+        service();
+    }
+
+    #endif
+
+    return 0;
+}
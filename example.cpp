@@ -16,6 +16,7 @@ using std::vector;
 #include "pico/stdlib.h"
 #include "pico/time.h"
 #include "wiFiStation.h"
+#include "wiFiLinkQuality.h"
 
 
 /*!
@@ -41,7 +42,9 @@ int main( void ){
     
     // Init Pi Pico
     stdio_init_all();
-    sleep_ms( 500 );
+
+    // Start initialising wifi chip. Chip comes up while waiting for the terminal
+    WiFiStation::startInitialise( CYW43_COUNTRY_GERMANY );
 
     // LED blinking
     repeating_timer led_timer;
@@ -49,17 +52,23 @@ int main( void ){
     add_repeating_timer_ms( 500, toggleLed, &toggle_led, &led_timer );
 
     // Time to start up serial terminal and not miss any output
-    sleep_ms( 4500 );
+    absolute_time_t terminal_wait_end = make_timeout_time_ms( 5000 );
+    while( get_absolute_time() < terminal_wait_end || WiFiStation::initStage() == WiFiStation::InitStage::driver ){
+        #ifdef USE_POLLING
+        WiFiStation::pollBlocking();
+        #else
+        WiFiStation::finishInitialise();
+        #endif
+    }
 
-    // Initialise wifi chip
-    WiFiStation::initialise( CYW43_COUNTRY_GERMANY );
+    printf( "Chip up after %u ms\r\n", static_cast<unsigned int>( ( WiFiStation::bootTiming().driver_us + WiFiStation::bootTiming().chip_us ) / 1000 ) );
 
     // Scan for networks and wait until scan is finished or 10 seconds passed
     WiFiStation::scanForWifis();
     absolute_time_t scan_end = make_timeout_time_ms( 5000 );
     while( WiFiStation::isScanActive() && get_absolute_time() < scan_end ){
         #ifdef USE_POLLING
-        WiFiStation::poll();
+        WiFiStation::pollBlocking();
         #endif
     }
 
@@ -116,7 +125,10 @@ int main( void ){
     
     // Start connection
     station.connect();
+    #ifdef USE_WATCHDOG
     WiFiStation::startWatchdog();
+    #endif
+    LinkQuality::start();
 
 
     // Flag to know when connection was made
@@ -152,6 +164,7 @@ int main( void ){
         // Print success
         if( reconnected_once && station.connected( false ) && !message_printed ){
             printf( "Reconnection after move-assignment successful!\r\n" );
+            LinkQuality::print();
             message_printed = true;
         }
 
@@ -169,8 +182,9 @@ int main( void ){
         }
 
         #ifdef USE_POLLING
-        WiFiStation::poll();
-        #else
+        // Sleep until the driver has work. Wake up often enough to blink the LED
+        WiFiStation::pollBlocking( 50000 );
+        #elif defined( USE_WATCHDOG )
         WiFiStation::updateWatchdog();
         #endif
     }
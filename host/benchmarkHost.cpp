@@ -0,0 +1,157 @@
+/*!
+ * @file benchmarkHost.cpp
+ * @author janwolzenburg
+ * @brief Host build of the network benchmark against lwIP
+ * @details "loopback" runs server and client over lwIP's loopback interface.
+ *          With tap support "tap <address> <netmask> <server>" runs server and, if server is given, client on a tap interface
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "lwip/init.h"
+#include "lwip/netif.h"
+#include "lwip/timeouts.h"
+#include "networkBenchmark.h"
+
+#ifdef USE_TAPIF
+#include "netif/tapif.h"
+#include "netif/ethernet.h"
+#endif
+
+
+/*!
+ * @brief Clock for benchmark
+ *
+ * @return uint64_t Microseconds since start of steady clock
+ */
+static uint64_t clockUs( void ){
+    return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+
+#ifdef USE_TAPIF
+static struct netif tap_netif;      /*!<Tap interface*/
+#endif
+
+
+/*!
+ * @brief Process lwIP timers and interfaces
+ *
+ */
+static void service( void ){
+    #ifdef USE_TAPIF
+    tapif_poll( &tap_netif );
+    #endif
+    netif_poll_all();
+    sys_check_timeouts();
+}
+
+
+/*!
+ * @brief Run all client modes against server
+ *
+ * @param benchmark Benchmark instance
+ * @param server Address of server
+ */
+static void runClient( NetworkBenchmark& benchmark, const ip_addr_t& server ){
+
+    NetworkBenchmark::Configuration configuration{};
+    configuration.server = server;
+    configuration.duration_ms = 5000;
+
+    const NetworkBenchmark::Mode modes[] = {
+        NetworkBenchmark::Mode::tcp_throughput,
+        NetworkBenchmark::Mode::udp_throughput,
+        NetworkBenchmark::Mode::tcp_latency,
+        NetworkBenchmark::Mode::udp_latency
+    };
+
+    for( const auto mode : modes ){
+        configuration.mode = mode;
+        configuration.payload_size = ( mode == NetworkBenchmark::Mode::tcp_latency || mode == NetworkBenchmark::Mode::udp_latency ) ?
+                                     32 : NetworkBenchmark::max_payload_size;
+
+        if( benchmark.start( configuration ) != 0 ){
+            continue;
+        }
+
+        while( benchmark.isRunning() ){
+            service();
+            benchmark.update();
+        }
+
+        NetworkBenchmark::printResult( benchmark.result() );
+    }
+}
+
+
+int main( int argc, char** argv ){
+
+    if( argc < 2 ){
+        printf( "Usage: %s loopback\n", argv[0] );
+        #ifdef USE_TAPIF
+        printf( "       %s tap <address> <netmask> [server]\n", argv[0] );
+        #endif
+        return -1;
+    }
+
+    lwip_init();
+
+    // Server and client in one process
+    NetworkBenchmark server{ clockUs };
+    NetworkBenchmark client{ clockUs };
+
+    if( strcmp( argv[1], "loopback" ) == 0 ){
+
+        if( server.startServer() != 0 ){
+            return -1;
+        }
+
+        ip_addr_t loopback;
+        ipaddr_aton( "127.0.0.1", &loopback );
+        runClient( client, loopback );
+
+        return 0;
+    }
+
+    #ifdef USE_TAPIF
+    if( strcmp( argv[1], "tap" ) == 0 && argc >= 4 ){
+
+        ip4_addr_t address, netmask, gateway;
+        ip4addr_aton( argv[2], &address );
+        ip4addr_aton( argv[3], &netmask );
+        ip4_addr_set_zero( &gateway );
+
+        netif_add( &tap_netif, &address, &netmask, &gateway, nullptr, tapif_init, ethernet_input );
+        netif_set_default( &tap_netif );
+        netif_set_up( &tap_netif );
+        netif_set_link_up( &tap_netif );
+
+        if( server.startServer() != 0 ){
+            return -1;
+        }
+
+        // Act as client when a server is given, else serve forever
+        if( argc >= 5 ){
+            ip_addr_t remote;
+            ipaddr_aton( argv[4], &remote );
+            runClient( client, remote );
+            return 0;
+        }
+
+        printf( "Benchmark server listening on port %u\n", NetworkBenchmark::default_port );
+        while( true ){
+            service();
+        }
+    }
+    #endif
+
+    printf( "Unknown mode %s\n", argv[1] );
+    return -1;
+}
@@ -0,0 +1,12 @@
+#ifndef _HOST_LWIPOPTS_H
+#define _HOST_LWIPOPTS_H
+
+// Host options on top of the device options. Loopback replaces the CYW43 interface
+
+#define LWIP_NETIF_LOOPBACK         1   // Loop packets to own addresses
+#define LWIP_HAVE_LOOPIF            1   // Add 127.0.0.1 interface
+#define LWIP_LOOPBACK_MAX_PBUFS     64  // Limit queued loopback packets
+
+#include "../../include/lwipopts.h"
+
+#endif
@@ -0,0 +1,177 @@
+/*!
+ * @file queueTestHost.cpp
+ * @author janwolzenburg
+ * @brief Outage test of OutboundQueue with flash overflow against stubbed driver and flash
+ * @details Fills the queue during link outages until it spills to flash and wraps the buffer and the flash region,
+ *          then drains it after the link is back while new messages keep arriving. Every message is a 4 byte counter,
+ *          so the sink can check that no message is lost, duplicated or reordered. Buffer and flash region sizes are
+ *          no powers of two. Prints one line of key=value pairs per outage and exits with 1 on the first error.
+ *
+ *          Usage: queueTestHost [outages]
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "picoStubs.h"
+#include "hardware/flash.h"
+#include "wiFiQueue.h"
+#include "wiFiStation.h"
+
+
+static constexpr size_t buffer_size = 4000;                         /*!<Queue buffer. No power of two*/
+static constexpr uint32_t flash_offset = 4 * FLASH_SECTOR_SIZE;     /*!<Start of flash region*/
+static constexpr uint32_t flash_size = 3 * FLASH_SECTOR_SIZE;       /*!<Flash region. No power of two*/
+
+static uint8_t buffer[buffer_size];             /*!<Queue buffer*/
+static uint32_t next_expected = 0;              /*!<Next counter the sink expects*/
+static bool sink_busy = false;                  /*!<Sink refuses batches*/
+
+
+/*!
+ * @brief Stop test with error
+ *
+ * @param message Error message
+ */
+static void fail( const char* const message ){
+    printf( "result=failed error=\"%s\" expected=%u\n", message, static_cast<unsigned int>( next_expected ) );
+    exit( 1 );
+}
+
+
+/*!
+ * @brief Sink checking the counters
+ *
+ */
+static int checkingSink( void* user_data, const uint8_t* data, uint16_t length ){
+    if( sink_busy )
+        return -1;
+
+    if( length == 0 || length % 4 != 0 || length > OutboundQueue::max_batch_size )
+        fail( "batch length" );
+
+    for( uint16_t position = 0; position < length; position += 4 ){
+        uint32_t counter = 0;
+        memcpy( &counter, &data[position], 4 );
+
+        if( counter != next_expected )
+            fail( "order" );
+
+        next_expected++;
+    }
+
+    return 0;
+}
+
+
+/*!
+ * @brief Advance clock, poll station and run workers
+ *
+ * @param us Microseconds to advance
+ */
+static void step( const uint64_t us ){
+    PicoStub::advance( us );
+    WiFiStation::poll();
+    PicoStub::runWorkers();
+}
+
+
+// connectionSink() is not used. The queue only needs these to link
+uint16_t TcpConnection::sendBufferSpace( void ) const{ return 0; }
+int TcpConnection::writeCopy( const void* data, const uint16_t length, const bool more ){ return -1; }
+int TcpConnection::flush( void ){ return -1; }
+
+
+int main( int argc, char** argv ){
+
+    const unsigned long outages = argc > 1 ? strtoul( argv[1], nullptr, 10 ) : 4;
+
+    PicoStub::reset();
+    WiFiStation::initialise();
+
+    OutboundQueue queue{ buffer, buffer_size, 20000, 3000 };
+    if( queue.setFlashOverflow( flash_offset, flash_size ) != 0 )
+        fail( "setFlashOverflow" );
+
+    queue.setSink( checkingSink, nullptr );
+
+    WiFiStation station{ "home", "password", CYW43_AUTH_WPA2_AES_PSK };
+    uint32_t counter = 0;
+
+    for( unsigned long outage = 0; outage < outages; outage++ ){
+
+        // Link down until the station noticed it
+        PicoStub::join_link_status = CYW43_LINK_DOWN;
+        PicoStub::link_status = CYW43_LINK_DOWN;
+        for( size_t check = 0; check < 50; check++ ){
+            step( 100000 );
+        }
+
+        // More than buffer and flash region hold together. Later outages wrap further
+        const size_t messages = 4000 + outage * 700;
+        uint32_t dropped = 0;
+        for( size_t message = 0; message < messages; message++ ){
+            if( queue.enqueue( &counter, sizeof( counter ) ) == 0 ){
+                counter++;
+            }
+            else{
+                dropped++;
+            }
+            PicoStub::runWorkers();
+        }
+
+        if( dropped == 0 )
+            fail( "queue never full" );
+
+        const size_t queued_in_outage = queue.queued();
+
+        // Link back. Sink refuses the first batches
+        PicoStub::join_link_status = CYW43_LINK_UP;
+        if( outage == 0 ){
+            station.connect();
+        }
+        sink_busy = true;
+
+        for( size_t check = 0; check < 400 && WiFiStation::connectionState() != WiFiStation::ConnectionState::connected; check++ ){
+            step( 100000 );
+        }
+        if( WiFiStation::connectionState() != WiFiStation::ConnectionState::connected )
+            fail( "no reconnect" );
+
+        for( size_t tick = 0; tick < 50; tick++ ){
+            step( 1000 );
+        }
+        sink_busy = false;
+
+        // Drain while new messages arrive
+        const uint64_t drain_start = PicoStub::time_us;
+        for( size_t tick = 0; tick < 60000 && queue.queued() > 0; tick++ ){
+            step( 1000 );
+
+            if( tick % 3 == 0 && queue.enqueue( &counter, sizeof( counter ) ) == 0 ){
+                counter++;
+            }
+        }
+
+        if( queue.queued() > 0 )
+            fail( "not drained" );
+
+        if( next_expected != counter )
+            fail( "messages lost" );
+
+        const OutboundQueue::Statistics& statistics = queue.statistics();
+        printf( "outage=%lu queued=%zu dropped=%u sent=%u batches=%u sink_busy=%u spilled_pages=%u flash_erases=%zu drain_ms=%u\n",
+                outage, queued_in_outage, static_cast<unsigned int>( dropped ),
+                static_cast<unsigned int>( statistics.sent ), static_cast<unsigned int>( statistics.batches ),
+                static_cast<unsigned int>( statistics.sink_busy ), static_cast<unsigned int>( statistics.spilled_pages ),
+                PicoStub::flash_erases, static_cast<unsigned int>( ( PicoStub::time_us - drain_start ) / 1000 ) );
+    }
+
+    printf( "result=ok messages=%u\n", static_cast<unsigned int>( counter ) );
+
+    return 0;
+}
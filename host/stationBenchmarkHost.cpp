@@ -0,0 +1,255 @@
+/*!
+ * @file stationBenchmarkHost.cpp
+ * @author janwolzenburg
+ * @brief Microbenchmark of the WiFiStation hot paths against stubbed driver
+ * @details Prints one JSON object per line with ns/op and heap allocations per op.
+ *          Optional argument is the minimum measuring time per benchmark in milliseconds
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <chrono>
+
+#include "picoStubs.h"
+#include "wiFiStation.h"
+#include "wiFiSelector.h"
+
+
+static size_t allocations = 0;          /*!<Number of heap allocations*/
+static size_t allocated_bytes = 0;      /*!<Bytes allocated*/
+
+
+void* operator new( size_t size ){
+    allocations++;
+    allocated_bytes += size;
+
+    void* const memory = malloc( size > 0 ? size : 1 );
+    if( memory == nullptr )
+        throw std::bad_alloc{};
+
+    return memory;
+}
+
+void* operator new[]( size_t size ){ return operator new( size ); }
+void operator delete( void* memory ) noexcept{ free( memory ); }
+void operator delete[]( void* memory ) noexcept{ free( memory ); }
+void operator delete( void* memory, size_t ) noexcept{ free( memory ); }
+void operator delete[]( void* memory, size_t ) noexcept{ free( memory ); }
+
+
+static uint64_t min_time_ns = 200000000;    /*!<Minimum measuring time per benchmark*/
+
+
+/*!
+ * @brief Clock for measurement
+ *
+ * @return uint64_t Nanoseconds of steady clock
+ */
+static uint64_t clockNs( void ){
+    return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+
+/*!
+ * @brief Run operation until minimum time passed and print result
+ * @details Iterations are doubled until a run lasts long enough
+ *
+ * @param name Name of measured path
+ * @param variant Variant of measurement
+ * @param results Number of scan results involved
+ * @param operations_per_call Operations done by one call of operation
+ * @param operation Operation
+ */
+template<typename Operation>
+static void measure( const char* const name, const char* const variant, const size_t results, const size_t operations_per_call, Operation operation ){
+
+    // Warm up
+    operation();
+
+    uint64_t iterations = 1;
+    while( true ){
+        const size_t allocations_start = allocations;
+        const size_t bytes_start = allocated_bytes;
+        const uint64_t start = clockNs();
+
+        for( uint64_t iteration = 0; iteration < iterations; iteration++ ){
+            operation();
+        }
+
+        const uint64_t elapsed = clockNs() - start;
+
+        if( elapsed >= min_time_ns || iterations >= ( UINT64_C( 1 ) << 40 ) ){
+            const double operations = static_cast<double>( iterations ) * static_cast<double>( operations_per_call );
+
+            printf( "{\"name\":\"%s\",\"variant\":\"%s\",\"results\":%zu,\"operations\":%.0f,\"ns_per_op\":%.2f,"
+                    "\"allocs_per_op\":%.4f,\"bytes_per_op\":%.1f}\n",
+                    name, variant, results, operations,
+                    static_cast<double>( elapsed ) / operations,
+                    static_cast<double>( allocations - allocations_start ) / operations,
+                    static_cast<double>( allocated_bytes - bytes_start ) / operations );
+            fflush( stdout );
+            return;
+        }
+
+        iterations *= 2;
+    }
+}
+
+
+/*!
+ * @brief Run operation on fresh input until minimum time passed and print result
+ * @details Like measure(), but prepare runs untimed before every call, e.g. to restore input the operation changes.
+ *          Every call is timed on its own, so the result includes the cost of one clock read
+ *
+ * @param name Name of measured path
+ * @param variant Variant of measurement
+ * @param results Number of scan results involved
+ * @param operations_per_call Operations done by one call of operation
+ * @param prepare Untimed preparation of every call
+ * @param operation Operation
+ */
+template<typename Prepare, typename Operation>
+static void measurePrepared( const char* const name, const char* const variant, const size_t results, const size_t operations_per_call,
+                             Prepare prepare, Operation operation ){
+
+    // Warm up
+    prepare();
+    operation();
+
+    uint64_t iterations = 1;
+    while( true ){
+        size_t allocations_sum = 0;
+        size_t bytes_sum = 0;
+        uint64_t elapsed = 0;
+
+        for( uint64_t iteration = 0; iteration < iterations; iteration++ ){
+            prepare();
+
+            const size_t allocations_start = allocations;
+            const size_t bytes_start = allocated_bytes;
+            const uint64_t start = clockNs();
+
+            operation();
+
+            elapsed += clockNs() - start;
+            allocations_sum += allocations - allocations_start;
+            bytes_sum += allocated_bytes - bytes_start;
+        }
+
+        if( elapsed >= min_time_ns || iterations >= ( UINT64_C( 1 ) << 40 ) ){
+            const double operations = static_cast<double>( iterations ) * static_cast<double>( operations_per_call );
+
+            printf( "{\"name\":\"%s\",\"variant\":\"%s\",\"results\":%zu,\"operations\":%.0f,\"ns_per_op\":%.2f,"
+                    "\"allocs_per_op\":%.4f,\"bytes_per_op\":%.1f}\n",
+                    name, variant, results, operations,
+                    static_cast<double>( elapsed ) / operations,
+                    static_cast<double>( allocations_sum ) / operations,
+                    static_cast<double>( bytes_sum ) / operations );
+            fflush( stdout );
+            return;
+        }
+
+        iterations *= 2;
+    }
+}
+
+
+/*!
+ * @brief Bring station into connected state
+ *
+ * @param station Station
+ */
+static void connectStation( WiFiStation& station ){
+    station.connect();
+    PicoStub::link_status = CYW43_LINK_UP;
+    PicoStub::advance( WiFiStation::connection_check_interval_us );
+    WiFiStation::poll();
+}
+
+
+/*!
+ * @brief Fill scan table of WiFiStation
+ *
+ * @param results Number of results
+ * @param repeats Deliveries per result
+ */
+static void fillScan( const size_t results, const size_t repeats = 1 ){
+    WiFiStation::scanForWifis();
+    PicoStub::deliverScanResults( 0, results, repeats );
+    PicoStub::endScan();
+    WiFiStation::isScanActive();
+}
+
+
+int main( int argc, char** argv ){
+
+    if( argc > 1 ){
+        min_time_ns = strtoull( argv[1], nullptr, 10 ) * 1000000;
+    }
+
+    PicoStub::reset();
+    WiFiStation::initialise();
+
+    // Poll without connection check
+    measure( "poll", "idle", 0, 1, [](){ WiFiStation::poll(); } );
+
+    WiFiStation station{ "home", "password", CYW43_AUTH_WPA2_AES_PSK };
+    connectStation( station );
+
+    // Poll with connection check not due. Clock stands still
+    measure( "poll", "check_not_due", 0, 1, [](){ WiFiStation::poll(); } );
+
+    // Poll with connection check on every call
+    measure( "poll", "check_due", 0, 1, [](){
+        PicoStub::advance( WiFiStation::connection_check_interval_us );
+        WiFiStation::poll();
+    } );
+
+    measure( "checkConnection", "connected", 0, 1, [&station](){ station.connected( true ); } );
+
+    station.disconnect();
+
+
+    const size_t result_counts[] = { 10, 100, 1000, 10000 };
+
+    // Scan results as delivered by the driver. One operation is one result. The table is freed before every
+    // scan, so the growth of the table is part of the result
+    for( const size_t results : result_counts ){
+        measurePrepared( "scanResult", "plain", results, results, [](){ WiFiStation::releaseScanResults(); },
+                         [results](){ fillScan( results ); } );
+    }
+
+    AccessPointSelector selector{ "home" };
+    WiFiStation::setAccessPointSelector( &selector );
+
+    for( const size_t results : result_counts ){
+        measurePrepared( "scanResult", "selector", results, results, [](){ WiFiStation::releaseScanResults(); },
+                         [results](){ fillScan( results ); } );
+    }
+
+    // Every access point heard in four beacons like in a real scan. One operation is one delivered result
+    for( const size_t results : result_counts ){
+        measurePrepared( "scanResult", "duplicates", results, results * 4, [](){ WiFiStation::releaseScanResults(); },
+                         [results](){ fillScan( results, 4 ); } );
+    }
+
+    WiFiStation::setAccessPointSelector( nullptr );
+
+
+    // Sorted copy of scan table. The table is sorted in place, so every call gets a fresh scan in driver order
+    for( const size_t results : result_counts ){
+        measurePrepared( "getAvailableWifis", "sorted", results, 1, [results](){ fillScan( results ); }, [](){
+            const vector<cyw43_ev_scan_result_t> networks = WiFiStation::getAvailableWifis();
+            if( networks.empty() ) abort();
+        } );
+    }
+
+    WiFiStation::deinitialise();
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef HARDWARE_FLASH_STUB_H
+#define HARDWARE_FLASH_STUB_H
+
+/*!
+ * @file flash.h
+ * @author janwolzenburg
+ * @brief Host stub of hardware/flash.h. Flash is an array in RAM mapped at XIP_BASE
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLASH_PAGE_SIZE         ( 1u << 8 )
+#define FLASH_SECTOR_SIZE       ( 1u << 12 )
+#define PICO_FLASH_SIZE_BYTES   ( 64u * 1024u )
+
+extern uint8_t stub_flash[PICO_FLASH_SIZE_BYTES];      /*!<Flash contents*/
+
+#define XIP_BASE                ( reinterpret_cast<uintptr_t>( stub_flash ) )
+
+void flash_range_erase( uint32_t flash_offs, size_t count );
+void flash_range_program( uint32_t flash_offs, const uint8_t* data, size_t count );
+
+#endif
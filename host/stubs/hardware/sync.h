@@ -0,0 +1,18 @@
+#ifndef HARDWARE_SYNC_STUB_H
+#define HARDWARE_SYNC_STUB_H
+
+/*!
+ * @file sync.h
+ * @author janwolzenburg
+ * @brief Host stub of hardware/sync.h. Host builds are single threaded
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+
+static inline uint32_t save_and_disable_interrupts( void ){ return 0; }
+static inline void restore_interrupts( const uint32_t status ){ (void)status; }
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef HARDWARE_WATCHDOG_STUB_H
+#define HARDWARE_WATCHDOG_STUB_H
+
+/*!
+ * @file watchdog.h
+ * @author janwolzenburg
+ * @brief Host stub of hardware/watchdog.h. Does nothing
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+static inline void watchdog_enable( const uint32_t delay_ms, const bool pause_on_debug ){ (void)delay_ms; (void)pause_on_debug; }
+static inline void watchdog_update( void ){}
+static inline bool watchdog_caused_reboot( void ){ return false; }
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef LWIP_ERR_STUB_H
+#define LWIP_ERR_STUB_H
+
+/*!
+ * @file err.h
+ * @author janwolzenburg
+ * @brief Host stub of lwip/err.h. Types only
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+
+#define ERR_OK      0
+#define ERR_MEM     -1
+#define ERR_CONN    -11
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef LWIP_IP_ADDR_STUB_H
+#define LWIP_IP_ADDR_STUB_H
+
+/*!
+ * @file ip_addr.h
+ * @author janwolzenburg
+ * @brief Host stub of lwip/ip_addr.h. Types only
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+
+typedef struct ip_addr{
+    uint32_t addr;
+} ip_addr_t;
+
+#endif
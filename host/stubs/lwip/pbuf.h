@@ -0,0 +1,25 @@
+#ifndef LWIP_PBUF_STUB_H
+#define LWIP_PBUF_STUB_H
+
+/*!
+ * @file pbuf.h
+ * @author janwolzenburg
+ * @brief Host stub of lwip/pbuf.h. Types only
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+#include "lwip/err.h"
+
+typedef enum{
+    PBUF_RAM,
+    PBUF_ROM,
+    PBUF_REF,
+    PBUF_POOL
+} pbuf_type;
+
+struct pbuf;
+
+#endif
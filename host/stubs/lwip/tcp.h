@@ -0,0 +1,20 @@
+#ifndef LWIP_TCP_STUB_H
+#define LWIP_TCP_STUB_H
+
+/*!
+ * @file tcp.h
+ * @author janwolzenburg
+ * @brief Host stub of lwip/tcp.h. Types only
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+
+#define TCP_MSS     1460
+
+struct tcp_pcb;
+
+#endif
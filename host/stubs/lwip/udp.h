@@ -0,0 +1,18 @@
+#ifndef LWIP_UDP_STUB_H
+#define LWIP_UDP_STUB_H
+
+/*!
+ * @file udp.h
+ * @author janwolzenburg
+ * @brief Host stub of lwip/udp.h. Types only
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+
+struct udp_pcb;
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PICO_ASYNC_CONTEXT_STUB_H
+#define PICO_ASYNC_CONTEXT_STUB_H
+
+/*!
+ * @file async_context.h
+ * @author janwolzenburg
+ * @brief Host stub of pico/async_context.h. Workers run in PicoStub::runWorkers()
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/time.h"
+
+typedef struct async_context async_context_t;
+
+typedef struct async_when_pending_worker{
+    struct async_when_pending_worker* next;
+    void (*do_work)( async_context_t* context, struct async_when_pending_worker* worker );
+    bool work_pending;
+    void* user_data;
+} async_when_pending_worker_t;
+
+typedef struct async_work_on_timeout{
+    struct async_work_on_timeout* next;
+    void (*do_work)( async_context_t* context, struct async_work_on_timeout* worker );
+    absolute_time_t next_time;
+    void* user_data;
+} async_at_time_worker_t;
+
+bool async_context_add_when_pending_worker( async_context_t* context, async_when_pending_worker_t* worker );
+bool async_context_remove_when_pending_worker( async_context_t* context, async_when_pending_worker_t* worker );
+void async_context_set_work_pending( async_context_t* context, async_when_pending_worker_t* worker );
+bool async_context_add_at_time_worker_in_ms( async_context_t* context, async_at_time_worker_t* worker, uint32_t ms );
+bool async_context_remove_at_time_worker( async_context_t* context, async_at_time_worker_t* worker );
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef PICO_CYW43_ARCH_STUB_H
+#define PICO_CYW43_ARCH_STUB_H
+
+/*!
+ * @file cyw43_arch.h
+ * @author janwolzenburg
+ * @brief Host stub of pico/cyw43_arch.h. Driver state is controlled through picoStubs.h
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/time.h"
+#include "pico/async_context.h"
+
+// Layout as in cyw43_ll.h
+typedef struct _cyw43_ev_scan_result_t{
+    uint32_t _0[5];
+    uint8_t bssid[6];
+    uint16_t _1[2];
+    uint8_t ssid_len;
+    uint8_t ssid[32];
+    uint32_t _2[5];
+    uint16_t channel;
+    uint16_t _3;
+    uint8_t auth_mode;
+    int16_t rssi;
+} cyw43_ev_scan_result_t;
+
+typedef struct _cyw43_wifi_scan_options_t{
+    uint32_t version;
+    uint16_t action;
+    uint16_t _;
+    uint32_t ssid_len;
+    uint8_t ssid[32];
+} cyw43_wifi_scan_options_t;
+
+typedef struct _cyw43_t{
+    int itf_state;
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+#define CYW43_ITF_STA               (0)
+#define CYW43_ITF_AP                (1)
+
+#define CYW43_LINK_DOWN             (0)
+#define CYW43_LINK_JOIN             (1)
+#define CYW43_LINK_NOIP             (2)
+#define CYW43_LINK_UP               (3)
+#define CYW43_LINK_FAIL             (-1)
+#define CYW43_LINK_NONET            (-2)
+#define CYW43_LINK_BADAUTH          (-3)
+
+#define CYW43_AUTH_OPEN             (0)
+#define CYW43_AUTH_WPA_TKIP_PSK     (0x00200002)
+#define CYW43_AUTH_WPA2_AES_PSK     (0x00400004)
+#define CYW43_AUTH_WPA2_MIXED_PSK   (0x00400006)
+
+#define CYW43_COUNTRY_WORLDWIDE     (0x5858)
+
+int cyw43_arch_init_with_country( uint32_t country );
+void cyw43_arch_enable_sta_mode( void );
+void cyw43_arch_deinit( void );
+void cyw43_arch_poll( void );
+void cyw43_arch_wait_for_work_until( absolute_time_t until );
+void cyw43_arch_lwip_begin( void );
+void cyw43_arch_lwip_end( void );
+async_context_t* cyw43_arch_async_context( void );
+
+int cyw43_arch_wifi_connect_async( const char* ssid, const char* password, uint32_t authentification );
+int cyw43_arch_wifi_connect_bssid_async( const char* ssid, const uint8_t* bssid, const char* password, uint32_t authentification );
+int cyw43_wifi_leave( cyw43_t* self, int itf );
+int cyw43_tcpip_link_status( cyw43_t* self, int itf );
+int cyw43_wifi_scan( cyw43_t* self, cyw43_wifi_scan_options_t* options, void* env, int (*result_cb)( void*, const cyw43_ev_scan_result_t* ) );
+bool cyw43_wifi_scan_active( cyw43_t* self );
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef PICO_TIME_STUB_H
+#define PICO_TIME_STUB_H
+
+/*!
+ * @file time.h
+ * @author janwolzenburg
+ * @brief Host stub of pico/time.h. Time is the virtual clock in picoStubs.h
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef uint64_t absolute_time_t;
+
+uint64_t time_us_64( void );
+
+static inline uint64_t to_us_since_boot( const absolute_time_t time ){ return time; }
+static inline absolute_time_t from_us_since_boot( const uint64_t time ){ return time; }
+static inline absolute_time_t get_absolute_time( void ){ return time_us_64(); }
+
+#endif
@@ -0,0 +1,308 @@
+/*!
+ * @file picoStubs.cpp
+ * @author janwolzenburg
+ * @brief Host stubs for the Pico SDK and CYW43 driver
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "picoStubs.h"
+#include "hardware/watchdog.h"
+#include "hardware/flash.h"
+
+
+cyw43_t cyw43_state = cyw43_t{};
+uint8_t stub_flash[PICO_FLASH_SIZE_BYTES] = {};
+
+uint64_t PicoStub::time_us = 0;
+int PicoStub::link_status = CYW43_LINK_DOWN;
+int PicoStub::join_link_status = CYW43_LINK_JOIN;
+bool PicoStub::scan_active = false;
+size_t PicoStub::driver_calls = 0;
+size_t PicoStub::flash_erases = 0;
+void* PicoStub::scan_env_ = nullptr;
+int (*PicoStub::scan_callback_)( void*, const cyw43_ev_scan_result_t* ) = nullptr;
+async_when_pending_worker_t* PicoStub::pending_workers_[max_workers] = {};
+async_at_time_worker_t* PicoStub::timed_workers_[max_workers] = {};
+
+
+void PicoStub::reset( void ){
+    time_us = 0;
+    link_status = CYW43_LINK_DOWN;
+    join_link_status = CYW43_LINK_JOIN;
+    scan_active = false;
+    driver_calls = 0;
+    flash_erases = 0;
+    scan_env_ = nullptr;
+    scan_callback_ = nullptr;
+    memset( stub_flash, 0xff, sizeof( stub_flash ) );
+}
+
+
+cyw43_ev_scan_result_t PicoStub::scanResult( const size_t index ){
+    cyw43_ev_scan_result_t result{};
+
+    // Locally administered MAC address from index
+    result.bssid[0] = 0x02;
+    result.bssid[2] = static_cast<uint8_t>( index >> 24 );
+    result.bssid[3] = static_cast<uint8_t>( index >> 16 );
+    result.bssid[4] = static_cast<uint8_t>( index >> 8 );
+    result.bssid[5] = static_cast<uint8_t>( index );
+
+    const int length = index % 8 == 0 ? snprintf( reinterpret_cast<char*>( result.ssid ), sizeof( result.ssid ), "home" ) :
+                                        snprintf( reinterpret_cast<char*>( result.ssid ), sizeof( result.ssid ), "network%zu", index );
+    result.ssid_len = static_cast<uint8_t>( length );
+
+    result.channel = static_cast<uint16_t>( 1 + ( index * 5 ) % 13 );
+    result.rssi = static_cast<int16_t>( -30 - static_cast<int>( ( index * 37 ) % 65 ) );
+
+    // Open, WPA2, WPA/WPA2 mixed and WEP
+    const uint8_t auth_modes[] = { 0x00, 0x05, 0x07, 0x01 };
+    result.auth_mode = auth_modes[index % 4];
+
+    return result;
+}
+
+
+size_t PicoStub::deliverScanResults( const size_t first, const size_t count, const size_t repeats ){
+    if( !scan_active || scan_callback_ == nullptr )
+        return 0;
+
+    for( size_t index = first; index < first + count; index++ ){
+        cyw43_ev_scan_result_t result = scanResult( index );
+        const int16_t rssi = result.rssi;
+
+        for( size_t repeat = 0; repeat < repeats; repeat++ ){
+            result.rssi = static_cast<int16_t>( rssi - static_cast<int>( repeat % 3 ) );
+            scan_callback_( scan_env_, &result );
+        }
+    }
+
+    return count * repeats;
+}
+
+
+bool PicoStub::deliverScanResult( const cyw43_ev_scan_result_t& result ){
+    if( !scan_active || scan_callback_ == nullptr )
+        return false;
+
+    scan_callback_( scan_env_, &result );
+    return true;
+}
+
+
+void PicoStub::endScan( void ){
+    scan_active = false;
+    scan_callback_ = nullptr;
+    scan_env_ = nullptr;
+}
+
+
+void PicoStub::runWorkers( void ){
+    for( async_when_pending_worker_t* const worker : pending_workers_ ){
+        if( worker != nullptr && worker->work_pending ){
+            worker->work_pending = false;
+            worker->do_work( nullptr, worker );
+        }
+    }
+
+    for( async_at_time_worker_t*& slot : timed_workers_ ){
+        async_at_time_worker_t* const worker = slot;
+        if( worker != nullptr && worker->next_time <= time_us ){
+            slot = nullptr;
+            worker->do_work( nullptr, worker );
+        }
+    }
+}
+
+
+uint64_t time_us_64( void ){
+    return PicoStub::time_us;
+}
+
+
+int cyw43_arch_init_with_country( uint32_t country ){
+    (void)country;
+    PicoStub::driver_calls++;
+    return 0;
+}
+
+
+void cyw43_arch_enable_sta_mode( void ){
+    PicoStub::driver_calls++;
+}
+
+
+void cyw43_arch_deinit( void ){
+    PicoStub::driver_calls++;
+}
+
+
+void cyw43_arch_poll( void ){
+    PicoStub::driver_calls++;
+}
+
+
+void cyw43_arch_wait_for_work_until( absolute_time_t until ){
+    // Sleeping ends at the deadline
+    if( until > PicoStub::time_us && until != UINT64_MAX ){
+        PicoStub::time_us = until;
+    }
+}
+
+
+void cyw43_arch_lwip_begin( void ){}
+
+
+void cyw43_arch_lwip_end( void ){}
+
+
+// Only its address is used. nullptr would mean the driver is not initialised
+struct async_context{};
+
+async_context_t* cyw43_arch_async_context( void ){
+    static async_context_t context;
+    return &context;
+}
+
+
+int cyw43_arch_wifi_connect_async( const char* ssid, const char* password, uint32_t authentification ){
+    (void)ssid; (void)password; (void)authentification;
+    PicoStub::driver_calls++;
+    PicoStub::link_status = PicoStub::join_link_status;
+    return 0;
+}
+
+
+int cyw43_arch_wifi_connect_bssid_async( const char* ssid, const uint8_t* bssid, const char* password, uint32_t authentification ){
+    (void)bssid;
+    return cyw43_arch_wifi_connect_async( ssid, password, authentification );
+}
+
+
+int cyw43_wifi_leave( cyw43_t* self, int itf ){
+    (void)self; (void)itf;
+    PicoStub::driver_calls++;
+    PicoStub::link_status = CYW43_LINK_DOWN;
+    return 0;
+}
+
+
+int cyw43_tcpip_link_status( cyw43_t* self, int itf ){
+    (void)self; (void)itf;
+    PicoStub::driver_calls++;
+    return PicoStub::link_status;
+}
+
+
+int cyw43_wifi_scan( cyw43_t* self, cyw43_wifi_scan_options_t* options, void* env, int (*result_cb)( void*, const cyw43_ev_scan_result_t* ) ){
+    (void)self; (void)options;
+    PicoStub::driver_calls++;
+
+    if( PicoStub::scan_active )
+        return -1;
+
+    PicoStub::scan_active = true;
+    PicoStub::scan_env_ = env;
+    PicoStub::scan_callback_ = result_cb;
+    return 0;
+}
+
+
+bool cyw43_wifi_scan_active( cyw43_t* self ){
+    (void)self;
+    PicoStub::driver_calls++;
+    return PicoStub::scan_active;
+}
+
+
+bool async_context_add_when_pending_worker( async_context_t* context, async_when_pending_worker_t* worker ){
+    (void)context;
+
+    for( async_when_pending_worker_t*& slot : PicoStub::pending_workers_ ){
+        if( slot == nullptr || slot == worker ){
+            slot = worker;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool async_context_remove_when_pending_worker( async_context_t* context, async_when_pending_worker_t* worker ){
+    (void)context;
+
+    for( async_when_pending_worker_t*& slot : PicoStub::pending_workers_ ){
+        if( slot == worker ){
+            slot = nullptr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void async_context_set_work_pending( async_context_t* context, async_when_pending_worker_t* worker ){
+    (void)context;
+    worker->work_pending = true;
+}
+
+
+bool async_context_add_at_time_worker_in_ms( async_context_t* context, async_at_time_worker_t* worker, uint32_t ms ){
+    (void)context;
+    worker->next_time = PicoStub::time_us + static_cast<uint64_t>( ms ) * 1000;
+
+    for( async_at_time_worker_t*& slot : PicoStub::timed_workers_ ){
+        if( slot == nullptr || slot == worker ){
+            slot = worker;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool async_context_remove_at_time_worker( async_context_t* context, async_at_time_worker_t* worker ){
+    (void)context;
+
+    for( async_at_time_worker_t*& slot : PicoStub::timed_workers_ ){
+        if( slot == worker ){
+            slot = nullptr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void flash_range_erase( uint32_t flash_offs, size_t count ){
+    // The SDK only erases whole sectors
+    if( flash_offs % FLASH_SECTOR_SIZE != 0 || count % FLASH_SECTOR_SIZE != 0 || flash_offs + count > PICO_FLASH_SIZE_BYTES ){
+        fprintf( stderr, "flash_range_erase: invalid range %u %zu\n", static_cast<unsigned int>( flash_offs ), count );
+        abort();
+    }
+
+    memset( &stub_flash[flash_offs], 0xff, count );
+    PicoStub::flash_erases += count / FLASH_SECTOR_SIZE;
+}
+
+
+void flash_range_program( uint32_t flash_offs, const uint8_t* data, size_t count ){
+    if( flash_offs % FLASH_PAGE_SIZE != 0 || count % FLASH_PAGE_SIZE != 0 || flash_offs + count > PICO_FLASH_SIZE_BYTES ){
+        fprintf( stderr, "flash_range_program: invalid range %u %zu\n", static_cast<unsigned int>( flash_offs ), count );
+        abort();
+    }
+
+    // Programming only clears bits
+    for( size_t index = 0; index < count; index++ ){
+        stub_flash[flash_offs + index] &= data[index];
+    }
+}
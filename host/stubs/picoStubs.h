@@ -0,0 +1,107 @@
+#ifndef PICOSTUBS_H
+#define PICOSTUBS_H
+
+/*!
+ * @file picoStubs.h
+ * @author janwolzenburg
+ * @brief Control of the host stubs for the Pico SDK and CYW43 driver
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stddef.h>
+#include "pico/cyw43_arch.h"
+
+
+/*!
+ * @brief State of the stubbed driver
+ * @details Time is virtual and only advances when set. Driver calls are counted
+ */
+class PicoStub{
+
+    public:
+
+    static uint64_t time_us;                /*!<Virtual clock returned by time_us_64()*/
+    static int link_status;                 /*!<Returned by cyw43_tcpip_link_status()*/
+    static int join_link_status;            /*!<Link status set by cyw43_arch_wifi_connect_async()*/
+    static bool scan_active;                /*!<Returned by cyw43_wifi_scan_active()*/
+    static size_t driver_calls;             /*!<Number of stubbed driver calls*/
+    static size_t flash_erases;             /*!<Number of erased flash sectors*/
+
+    /*!
+     * @brief Reset state
+     *
+     */
+    static void reset( void );
+
+    /*!
+     * @brief Advance virtual clock
+     *
+     * @param us Microseconds
+     */
+    static void advance( const uint64_t us ){ time_us += us; };
+
+    /*!
+     * @brief Generate a scan result
+     * @details Results differ in MAC address, channel, RSSI and authentification. Every eighth result has the same SSID
+     *
+     * @param index Index of result
+     * @return cyw43_ev_scan_result_t Result
+     */
+    static cyw43_ev_scan_result_t scanResult( const size_t index );
+
+    /*!
+     * @brief Pass results to the callback of the running scan
+     * @details The driver reports an access point once per beacon or probe response. Repeats of a result
+     *          follow each other with slightly different RSSI
+     *
+     * @param first Index of first result
+     * @param count Number of results
+     * @param repeats Deliveries per result
+     * @return size_t Number of results delivered. 0 when no scan is running
+     */
+    static size_t deliverScanResults( const size_t first, const size_t count, const size_t repeats = 1 );
+
+    /*!
+     * @brief Pass one result to the callback of the running scan
+     *
+     * @param result Result
+     * @return true When a scan is running
+     * @return false Otherwise
+     */
+    static bool deliverScanResult( const cyw43_ev_scan_result_t& result );
+
+    /*!
+     * @brief End running scan
+     *
+     */
+    static void endScan( void );
+
+    /*!
+     * @brief Run pending workers and at time workers that are due
+     * @details At time workers are removed before they run like in the SDK
+     *
+     */
+    static void runWorkers( void );
+
+
+    private:
+
+    static void* scan_env_;                                                 /*!<Environment of running scan*/
+    static int (*scan_callback_)( void*, const cyw43_ev_scan_result_t* );   /*!<Callback of running scan*/
+
+    static constexpr size_t max_workers = 16;                               /*!<Workers of each kind*/
+    static async_when_pending_worker_t* pending_workers_[max_workers];      /*!<Added when pending workers*/
+    static async_at_time_worker_t* timed_workers_[max_workers];             /*!<Added at time workers*/
+
+    friend bool async_context_add_when_pending_worker( async_context_t*, async_when_pending_worker_t* );
+    friend bool async_context_remove_when_pending_worker( async_context_t*, async_when_pending_worker_t* );
+    friend bool async_context_add_at_time_worker_in_ms( async_context_t*, async_at_time_worker_t*, uint32_t );
+    friend bool async_context_remove_at_time_worker( async_context_t*, async_at_time_worker_t* );
+
+    friend int cyw43_wifi_scan( cyw43_t*, cyw43_wifi_scan_options_t*, void*, int (*)( void*, const cyw43_ev_scan_result_t* ) );
+
+};
+
+#endif
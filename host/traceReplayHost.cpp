@@ -0,0 +1,288 @@
+/*!
+ * @file traceReplayHost.cpp
+ * @author janwolzenburg
+ * @brief Replay of a link trace through WiFiStation with a virtual clock
+ * @details Reads the output of LinkTrace::dump(). Connect requests, link status seen by connection checks and scans are fed
+ *          into WiFiStation at their recorded times. WiFiStation runs its own connection checks and deadlines.
+ *          Outages of the recorded and the replayed run are compared.
+ *          Link status is only known at the recorded checks and the driver reacts to the replayed joins like in the recording,
+ *          so the replay shows the effect of changed checks, deadlines and backoff on real sequences.
+ *
+ *          Usage: traceReplayHost <trace> [-i check interval ms] [-j join timeout ms] [-n no IP timeout ms] [-b initial backoff ms] [-m maximum backoff ms] [-v]
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+using std::vector;
+
+#include "picoStubs.h"
+#include "wiFiStation.h"
+#include "wiFiTrace.h"
+
+
+/*!
+ * @brief Transition seen in recording or replay
+ *
+ */
+struct transition_record_t{
+    uint64_t time_us;                       /*!<Time of transition*/
+    WiFiStation::ConnectionState from;      /*!<Previous state*/
+    WiFiStation::ConnectionState to;        /*!<New state*/
+};
+
+
+static bool verbose = false;                            /*!<Print replayed transitions*/
+static vector<transition_record_t> replayed{};          /*!<Transitions of replay*/
+
+
+/*!
+ * @brief Read trace dump
+ *
+ * @param file File with dump. Other lines are ignored
+ * @param records Records read
+ * @return int 0 on success
+ */
+static int readTrace( FILE* const file, vector<LinkTrace::record_t>& records ){
+    char line[256];
+
+    while( fgets( line, sizeof( line ), file ) != nullptr ){
+
+        const char* const start = strstr( line, "TRACE " );
+        if( start == nullptr )
+            continue;
+
+        const char* hex = start + strlen( "TRACE " );
+        if( strncmp( hex, "begin", 5 ) == 0 || strncmp( hex, "end", 3 ) == 0 )
+            continue;
+
+        LinkTrace::record_t record{};
+        uint8_t* const bytes = reinterpret_cast<uint8_t*>( &record );
+
+        for( size_t byte = 0; byte < sizeof( record ); byte++ ){
+            unsigned int value = 0;
+            if( sscanf( hex + 2 * byte, "%2x", &value ) != 1 ){
+                fprintf( stderr, "Malformed trace line: %s", line );
+                return -1;
+            }
+            bytes[byte] = static_cast<uint8_t>( value );
+        }
+
+        records.push_back( record );
+    }
+
+    return 0;
+}
+
+
+/*!
+ * @brief Collect transitions of replay
+ *
+ */
+static void transitionCallback( void* user_data, const WiFiStation::transition_t& transition ){
+    (void)user_data;
+    replayed.push_back( transition_record_t{ transition.time_us, transition.from, transition.to } );
+
+    if( verbose ){
+        printf( "replay t_ms=%llu %s -> %s\n", static_cast<unsigned long long>( transition.time_us / 1000 ),
+                WiFiStation::stateName( transition.from ), WiFiStation::stateName( transition.to ) );
+    }
+}
+
+
+/*!
+ * @brief Run WiFiStation until time
+ * @details Jumps from deadline to deadline as returned by poll()
+ *
+ * @param time Time in microseconds
+ */
+static void runUntil( const uint64_t time ){
+    while( true ){
+        const uint64_t next = WiFiStation::poll();
+        if( next > time )
+            break;
+
+        PicoStub::time_us = next > PicoStub::time_us ? next : PicoStub::time_us + 1;
+    }
+
+    if( time > PicoStub::time_us ){
+        PicoStub::time_us = time;
+    }
+    WiFiStation::poll();
+}
+
+
+/*!
+ * @brief Print outage statistics
+ *
+ * @param source Name of run
+ * @param transitions Transitions
+ * @param end Time at end of run
+ */
+static void printOutages( const char* const source, const vector<transition_record_t>& transitions, const uint64_t end ){
+    size_t outages = 0;
+    size_t resolved = 0;
+    uint64_t total_us = 0;
+    uint64_t maximum_us = 0;
+    uint64_t lost_at = 0;
+    bool lost = false;
+
+    for( const auto& transition : transitions ){
+        if( transition.from == WiFiStation::ConnectionState::connected && transition.to != WiFiStation::ConnectionState::connected &&
+            transition.to != WiFiStation::ConnectionState::idle ){
+            outages++;
+            lost = true;
+            lost_at = transition.time_us;
+        }
+        else if( lost && transition.to == WiFiStation::ConnectionState::connected ){
+            const uint64_t duration = transition.time_us - lost_at;
+            total_us += duration;
+            if( duration > maximum_us ) maximum_us = duration;
+            resolved++;
+            lost = false;
+        }
+        else if( lost && transition.to == WiFiStation::ConnectionState::idle ){
+            lost = false;
+        }
+    }
+
+    // Outage lasting until end of trace
+    if( lost ){
+        const uint64_t duration = end - lost_at;
+        total_us += duration;
+        if( duration > maximum_us ) maximum_us = duration;
+    }
+
+    printf( "source=%s transitions=%zu outages=%zu resolved=%zu total_ms=%llu mean_ms=%llu max_ms=%llu\n",
+            source, transitions.size(), outages, resolved,
+            static_cast<unsigned long long>( total_us / 1000 ),
+            static_cast<unsigned long long>( outages > 0 ? total_us / 1000 / outages : 0 ),
+            static_cast<unsigned long long>( maximum_us / 1000 ) );
+}
+
+
+int main( int argc, char** argv ){
+
+    if( argc < 2 ){
+        fprintf( stderr, "Usage: %s <trace> [-i check interval ms] [-j join timeout ms] [-n no IP timeout ms] [-b initial backoff ms] [-m maximum backoff ms] [-v]\n", argv[0] );
+        return -1;
+    }
+
+    uint32_t backoff_initial_ms = 1000;
+    uint32_t backoff_maximum_ms = 32000;
+
+    for( int argument = 2; argument < argc; argument++ ){
+        const bool has_value = argument + 1 < argc;
+
+        if( strcmp( argv[argument], "-v" ) == 0 ){
+            verbose = true;
+        }
+        else if( has_value && strcmp( argv[argument], "-i" ) == 0 ){
+            WiFiStation::connection_check_interval_us = static_cast<uint32_t>( strtoul( argv[++argument], nullptr, 10 ) * 1000 );
+        }
+        else if( has_value && strcmp( argv[argument], "-j" ) == 0 ){
+            WiFiStation::setStateTimeout( WiFiStation::ConnectionState::joining, static_cast<uint32_t>( strtoul( argv[++argument], nullptr, 10 ) ) );
+        }
+        else if( has_value && strcmp( argv[argument], "-n" ) == 0 ){
+            WiFiStation::setStateTimeout( WiFiStation::ConnectionState::no_ip, static_cast<uint32_t>( strtoul( argv[++argument], nullptr, 10 ) ) );
+        }
+        else if( has_value && strcmp( argv[argument], "-b" ) == 0 ){
+            backoff_initial_ms = static_cast<uint32_t>( strtoul( argv[++argument], nullptr, 10 ) );
+        }
+        else if( has_value && strcmp( argv[argument], "-m" ) == 0 ){
+            backoff_maximum_ms = static_cast<uint32_t>( strtoul( argv[++argument], nullptr, 10 ) );
+        }
+        else{
+            fprintf( stderr, "Unknown argument %s\n", argv[argument] );
+            return -1;
+        }
+    }
+
+    WiFiStation::setBackoff( backoff_initial_ms, backoff_maximum_ms );
+
+
+    FILE* const file = fopen( argv[1], "r" );
+    if( file == nullptr ){
+        fprintf( stderr, "Cannot open %s\n", argv[1] );
+        return -1;
+    }
+
+    vector<LinkTrace::record_t> records{};
+    const int read_error = readTrace( file, records );
+    fclose( file );
+
+    if( read_error != 0 || records.empty() ){
+        fprintf( stderr, "No trace records found\n" );
+        return -1;
+    }
+
+
+    PicoStub::reset();
+    PicoStub::time_us = records.front().time();
+
+    WiFiStation::initialise();
+    WiFiStation::setTransitionCallback( transitionCallback, nullptr );
+
+    WiFiStation station{};
+    vector<transition_record_t> recorded{};
+
+    for( const auto& record : records ){
+
+        runUntil( record.time() );
+
+        switch( record.type ){
+
+            case LinkTrace::Type::connect:{
+                uint32_t authentification;
+                memcpy( &authentification, record.data, sizeof( authentification ) );
+
+                // Credentials are not recorded
+                if( station.authentification() != authentification || station.ssid().empty() ){
+                    station = WiFiStation{ "replay", "password", authentification };
+                }
+                station.connect( record.value != 0 );
+            }
+            break;
+
+            case LinkTrace::Type::disconnect: station.disconnect(); break;
+
+            case LinkTrace::Type::stop_connecting: station.stopConnecting(); break;
+
+            case LinkTrace::Type::check: PicoStub::link_status = record.value; break;
+
+            case LinkTrace::Type::transition:
+                recorded.push_back( transition_record_t{ record.time(),
+                                                         static_cast<WiFiStation::ConnectionState>( record.data[0] ),
+                                                         static_cast<WiFiStation::ConnectionState>( record.value ) } );
+            break;
+
+            case LinkTrace::Type::scan_start: WiFiStation::scanForWifis(); break;
+
+            case LinkTrace::Type::scan_result:{
+                cyw43_ev_scan_result_t result{};
+                memcpy( result.bssid, record.data, sizeof( result.bssid ) );
+                result.channel = record.data[6];
+                result.auth_mode = record.data[7];
+                result.rssi = record.value;
+                PicoStub::deliverScanResult( result );
+            }
+            break;
+
+            case LinkTrace::Type::scan_end: PicoStub::endScan(); break;
+
+            default: break;
+        }
+    }
+
+    const uint64_t end = records.back().time();
+    runUntil( end );
+
+    printOutages( "recorded", recorded, end );
+    printOutages( "replayed", replayed, end );
+
+    return 0;
+}
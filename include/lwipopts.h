@@ -33,9 +33,21 @@
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
 #define LWIP_NETCONN                0
+
+// Set to 1 to report lwIP heap and pool usage with MemoryReport. Costs some RAM and cycles per allocation
+#ifndef WIFI_LWIP_MEMORY_STATS
+#define WIFI_LWIP_MEMORY_STATS      0
+#endif
+
+#if WIFI_LWIP_MEMORY_STATS
+#define LWIP_STATS                  1
+#define MEM_STATS                   1
+#define MEMP_STATS                  1
+#else
 #define MEM_STATS                   0
-#define SYS_STATS                   0
 #define MEMP_STATS                  0
+#endif
+#define SYS_STATS                   0
 #define LINK_STATS                  0
 // #define ETH_PAD_SIZE                2
 #define LWIP_CHKSUM_ALGORITHM       3
@@ -51,7 +63,9 @@
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
+#ifndef LWIP_STATS
 #define LWIP_STATS                  1
+#endif
 #define LWIP_STATS_DISPLAY          1
 #endif
 
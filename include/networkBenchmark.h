@@ -0,0 +1,314 @@
+#ifndef NETWORKBENCHMARK_H
+#define NETWORKBENCHMARK_H
+
+/*!
+ * @file networkBenchmark.h
+ * @author janwolzenburg
+ * @brief Class definition of NetworkBenchmark
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+using std::vector;
+
+#include "lwip/ip_addr.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+
+
+/*!
+ * @brief Throughput and latency benchmark on top of the lwIP raw API
+ * @details Does not depend on the Pico SDK so the same code can be built against lwIP on a host.
+ *          The client side measures throughput, packets per second and request/response latency.
+ *          The server side sinks or echoes what the client sends. Call update() regularly while running
+ */
+class NetworkBenchmark{
+
+    public:
+
+    static constexpr uint16_t default_port = 5001;              /*!<Default port for server and client*/
+    static constexpr uint16_t max_payload_size = 1460;          /*!<Maximum payload per request or datagram*/
+
+    /*!
+     * @brief Function returning a monotonic time in microseconds
+     *
+     */
+    typedef uint64_t (*clock_us_t)( void );
+
+    /*!
+     * @brief Test to run on client side
+     *
+     */
+    enum class Mode{
+        tcp_throughput,         /*!<Stream data to server as fast as TCP allows*/
+        udp_throughput,         /*!<Send datagrams as fast as pbufs are available*/
+        tcp_latency,            /*!<Request/response round trips over one TCP connection*/
+        udp_latency             /*!<Request/response round trips with single datagrams*/
+    };
+
+    /*!
+     * @brief Client configuration
+     *
+     */
+    struct Configuration{
+        Mode mode = Mode::tcp_throughput;           /*!<Test to run*/
+        ip_addr_t server{};                         /*!<Address of benchmark server*/
+        uint16_t port = default_port;               /*!<Port of benchmark server*/
+        uint16_t payload_size = max_payload_size;   /*!<Bytes per write, datagram or request*/
+        uint32_t duration_ms = 10000;               /*!<Test duration*/
+        uint32_t max_samples = 1000;                /*!<Maximum latency samples to store*/
+        uint32_t response_timeout_ms = 1000;        /*!<Time until a latency request counts as lost*/
+    };
+
+    /*!
+     * @brief Result of one test
+     *
+     */
+    struct Result{
+        Mode mode = Mode::tcp_throughput;   /*!<Test that was run*/
+        uint64_t elapsed_us = 0;            /*!<Duration of test*/
+        uint64_t bytes = 0;                 /*!<Payload bytes acknowledged or sent*/
+        uint32_t packets = 0;               /*!<Writes, datagrams or completed requests*/
+        uint32_t errors = 0;                /*!<Failed sends or lost responses*/
+        uint32_t throughput_kbit_s = 0;     /*!<Payload throughput in kbit/s*/
+        uint32_t packets_per_s = 0;         /*!<Packets per second*/
+        uint32_t latency_samples = 0;       /*!<Number of latency samples*/
+        uint32_t latency_min_us = 0;        /*!<Minimal round trip time*/
+        uint32_t latency_p50_us = 0;        /*!<Median round trip time*/
+        uint32_t latency_p90_us = 0;        /*!<90th percentile round trip time*/
+        uint32_t latency_p99_us = 0;        /*!<99th percentile round trip time*/
+        uint32_t latency_max_us = 0;        /*!<Maximal round trip time*/
+        bool completed = false;             /*!<Test ran for the full duration*/
+    };
+
+    /*!
+     * @brief Constructor
+     *
+     * @param clock Monotonic clock in microseconds
+     */
+    NetworkBenchmark( const clock_us_t clock );
+
+    /*!
+     * @brief Destructor. Stops client and server
+     *
+     */
+    ~NetworkBenchmark( void );
+
+    /*!
+     * @brief No copy contructor
+     *
+     */
+    NetworkBenchmark( const NetworkBenchmark& benchmark ) = delete;
+
+    /*!
+     * @brief Copy assignment deleted
+     *
+     */
+    NetworkBenchmark& operator=( const NetworkBenchmark& benchmark ) = delete;
+
+    /*!
+     * @brief Start server
+     * @details TCP data on port is discarded and TCP data on port + 1 is echoed.
+     *          UDP datagrams on port are discarded or echoed depending on their first byte
+     *
+     * @param port Port to listen on
+     * @return int 0 on success
+     */
+    int startServer( const uint16_t port = default_port );
+
+    /*!
+     * @brief Stop server
+     *
+     */
+    void stopServer( void );
+
+    /*!
+     * @brief Start a client test
+     * @details Does return directly. Check with isRunning() whether test finished
+     *
+     * @param configuration Test configuration
+     * @return int 0 on successful start
+     */
+    int start( const Configuration& configuration );
+
+    /*!
+     * @brief Stop client test and compute result
+     *
+     */
+    void stop( void );
+
+    /*!
+     * @brief Drive client test. Call regularly
+     *
+     */
+    void update( void );
+
+    /*!
+     * @brief Get whether client test is running
+     *
+     * @return true When running
+     * @return false Otherwise
+     */
+    bool isRunning( void ) const{ return running_; };
+
+    /*!
+     * @brief Get result of last client test
+     *
+     * @return Result The result
+     */
+    Result result( void ) const{ return result_; };
+
+    /*!
+     * @brief Get bytes received by server since start
+     *
+     * @return uint64_t Received bytes
+     */
+    uint64_t serverBytes( void ) const{ return server_bytes_; };
+
+    /*!
+     * @brief Get packets received by server since start
+     *
+     * @return uint32_t Received TCP segments and UDP datagrams
+     */
+    uint32_t serverPackets( void ) const{ return server_packets_; };
+
+    /*!
+     * @brief Print result as one line of key=value pairs
+     *
+     * @param result Result to print
+     */
+    static void printResult( const Result& result );
+
+    /*!
+     * @brief Get name of test mode
+     *
+     * @param mode Test mode
+     * @return const char* Name
+     */
+    static const char* modeName( const Mode mode );
+
+
+    private:
+
+    static constexpr uint8_t marker_sink = 'S';     /*!<First datagram byte: server only counts*/
+    static constexpr uint8_t marker_echo = 'E';     /*!<First datagram byte: server echoes*/
+    static constexpr uint16_t header_size = 5;      /*!<Marker and sequence number*/
+    static constexpr size_t max_server_connections = 4; /*!<Accepted TCP connections served at once*/
+
+    /*!
+     * @brief Accepted server connection. Argument of its callbacks
+     *
+     */
+    struct server_connection_t{
+        NetworkBenchmark* benchmark;    /*!<Owning benchmark*/
+        struct tcp_pcb* pcb;            /*!<Accepted pcb. nullptr when slot is free*/
+        struct pbuf* pending;           /*!<Received data not yet echoed and not yet acknowledged*/
+        uint16_t echoed;                /*!<Bytes at start of pending already echoed*/
+    };
+
+    static uint8_t payload_[max_payload_size];      /*!<Constant payload sent from flash or RAM without copy*/
+
+    clock_us_t clock_;                  /*!<Time source*/
+    Configuration configuration_;       /*!<Configuration of running test*/
+    Result result_;                     /*!<Result of running or last test*/
+    bool running_;                      /*!<Client test is running*/
+    uint64_t start_time_;               /*!<Start of client test*/
+
+    struct tcp_pcb* client_tcp_;        /*!<Client TCP connection*/
+    struct udp_pcb* client_udp_;        /*!<Client UDP socket*/
+    bool client_connected_;             /*!<TCP client connection established*/
+
+    uint32_t sequence_;                 /*!<Sequence number of outstanding request*/
+    uint64_t request_time_;             /*!<Time the outstanding request was sent*/
+    bool request_pending_;              /*!<Waiting for response*/
+    uint16_t response_bytes_;           /*!<Bytes of outstanding response received*/
+    uint8_t request_[max_payload_size]; /*!<Buffer for latency request*/
+    vector<uint32_t> latencies_;        /*!<Round trip time samples*/
+
+    struct tcp_pcb* server_sink_;       /*!<Server TCP connection discarding data*/
+    struct tcp_pcb* server_echo_;       /*!<Server TCP connection echoing data*/
+    struct udp_pcb* server_udp_;        /*!<Server UDP socket*/
+    server_connection_t server_connections_[max_server_connections];   /*!<Accepted connections*/
+    uint64_t server_bytes_;             /*!<Bytes received on server*/
+    uint32_t server_packets_;           /*!<Packets received on server*/
+
+
+    /*!
+     * @brief Close client connections without locking
+     *
+     * @return err_t ERR_OK or ERR_ABRT when the TCP connection had to be aborted
+     */
+    err_t closeClient( void );
+
+    /*!
+     * @brief Fill TCP send buffer with payload
+     *
+     */
+    void fillTcpSendBuffer( void );
+
+    /*!
+     * @brief Send next latency request
+     *
+     * @return err_t lwIP error code
+     */
+    err_t sendRequest( void );
+
+    /*!
+     * @brief Account received response bytes
+     *
+     * @param length Number of received bytes
+     */
+    void receivedResponse( const uint16_t length );
+
+    /*!
+     * @brief Compute percentiles and rates into result_
+     *
+     */
+    void computeResult( void );
+
+    /*!
+     * @brief Take slot for accepted connection and set its callbacks
+     *
+     * @param pcb Accepted pcb
+     * @param received Receive callback
+     * @return err_t ERR_OK or ERR_ABRT when pcb was aborted because no slot is free
+     */
+    err_t acceptConnection( struct tcp_pcb* pcb, tcp_recv_fn received );
+
+    /*!
+     * @brief Close accepted connection and free its slot without locking
+     *
+     * @param connection Slot of connection
+     * @return err_t ERR_OK or ERR_ABRT when closing failed and pcb was aborted
+     */
+    static err_t closeConnection( server_connection_t* const connection );
+
+    /*!
+     * @brief Echo pending data as far as the send buffer allows
+     * @details Only echoed data is acknowledged, so the client is throttled by the receive window
+     *
+     * @param connection Slot of echo connection
+     */
+    static void echoPending( server_connection_t* const connection );
+
+    static err_t clientConnected( void* argument, struct tcp_pcb* pcb, err_t error );
+    static err_t clientSent( void* argument, struct tcp_pcb* pcb, uint16_t length );
+    static err_t clientReceived( void* argument, struct tcp_pcb* pcb, struct pbuf* buffer, err_t error );
+    static void clientError( void* argument, err_t error );
+    static void clientUdpReceived( void* argument, struct udp_pcb* pcb, struct pbuf* buffer, const ip_addr_t* address, uint16_t port );
+
+    static err_t serverSinkAccepted( void* argument, struct tcp_pcb* pcb, err_t error );
+    static err_t serverEchoAccepted( void* argument, struct tcp_pcb* pcb, err_t error );
+    static err_t serverSinkReceived( void* argument, struct tcp_pcb* pcb, struct pbuf* buffer, err_t error );
+    static err_t serverEchoReceived( void* argument, struct tcp_pcb* pcb, struct pbuf* buffer, err_t error );
+    static err_t serverEchoSent( void* argument, struct tcp_pcb* pcb, uint16_t length );
+    static void serverError( void* argument, err_t error );
+    static void serverUdpReceived( void* argument, struct udp_pcb* pcb, struct pbuf* buffer, const ip_addr_t* address, uint16_t port );
+
+};
+
+#endif
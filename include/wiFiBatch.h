@@ -0,0 +1,224 @@
+#ifndef WIFIBATCH_H
+#define WIFIBATCH_H
+
+/*!
+ * @file wiFiBatch.h
+ * @author janwolzenburg
+ * @brief Class definition of BatchSender
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
+#include "lwip/ip_addr.h"
+#include "lwip/tcp.h"
+#include "wiFiTransport.h"
+
+
+/*!
+ * @brief Sender coalescing small messages into frames of up to one MSS
+ * @details Messages are copied into a frame which is sent when it reaches the size threshold, when its oldest message
+ *          reaches the age deadline or on flush(). While the radio is in power save mode a longer deadline applies,
+ *          so the radio wakes less often. Frames do not keep message boundaries, so messages should be self-delimiting.
+ *          Sends to a TcpConnection or a UdpEndpoint.
+ *          Public methods take the lwIP lock. It is recursive, so link callbacks and workers may call them too
+ */
+class BatchSender{
+
+    public:
+
+    static constexpr uint16_t frame_size = TCP_MSS;         /*!<Largest frame and message in bytes*/
+
+    /*!
+     * @brief Reason a frame was sent
+     *
+     */
+    enum class FlushReason{
+        size,                           /*!<Size threshold reached*/
+        age,                            /*!<Age deadline reached*/
+        manual,                         /*!<flush() called*/
+        link_up,                        /*!<Frame held back during a link outage*/
+        count
+    };
+
+    /*!
+     * @brief Sender statistics
+     *
+     */
+    struct Statistics{
+        uint32_t messages;                                          /*!<Messages sent*/
+        uint32_t frames;                                            /*!<Frames sent*/
+        uint32_t bytes;                                             /*!<Bytes sent*/
+        uint32_t rejected;                                          /*!<Messages rejected because frame could not be sent*/
+        uint32_t send_failures;                                     /*!<Failed attempts to send a frame*/
+        uint32_t flushes[static_cast<size_t>( FlushReason::count )];    /*!<Frames sent per reason*/
+        uint64_t latency_sum_us;                                    /*!<Sum of time messages waited in a frame*/
+        uint32_t latency_max_us;                                    /*!<Longest time a message waited in a frame*/
+    };
+
+    /*!
+     * @brief Constructor
+     *
+     * @param max_age_ms Age deadline of a frame while the radio is awake
+     * @param power_save_max_age_ms Age deadline of a frame while the radio is in power save mode
+     * @param flush_threshold Frame size in bytes that triggers sending. At most frame_size
+     */
+    BatchSender( const uint32_t max_age_ms = 20, const uint32_t power_save_max_age_ms = 200, const uint16_t flush_threshold = frame_size );
+
+    /*!
+     * @brief Destructor. Discards unsent messages
+     *
+     */
+    ~BatchSender( void );
+
+    /*!
+     * @brief No copy contructor
+     *
+     */
+    BatchSender( const BatchSender& sender ) = delete;
+
+    /*!
+     * @brief Copy assignment deleted
+     *
+     */
+    BatchSender& operator=( const BatchSender& sender ) = delete;
+
+    /*!
+     * @brief Send frames over TCP connection
+     *
+     * @param connection Connection. Must outlive sender or be replaced
+     */
+    void setDestination( TcpConnection* const connection );
+
+    /*!
+     * @brief Send frames as UDP datagrams
+     *
+     * @param endpoint Open endpoint. Must outlive sender or be replaced
+     * @param address Destination address
+     * @param port Destination port
+     */
+    void setDestination( UdpEndpoint* const endpoint, const ip_addr_t& address, const uint16_t port );
+
+    /*!
+     * @brief Add copy of message to frame
+     * @details Sends the frame first when the message does not fit
+     *
+     * @param data Message
+     * @param length Message length. At most frame_size
+     * @return int 0 on success, -1 when message is too long or the full frame could not be sent
+     */
+    int add( const void* const data, const uint16_t length );
+
+    /*!
+     * @brief Send frame now
+     *
+     * @return int 0 on success or when frame is empty, lwIP error code otherwise
+     */
+    int flush( void );
+
+    /*!
+     * @brief Read power save mode from driver
+     * @details Called on every link up. Call after changing it with cyw43_wifi_pm()
+     *
+     */
+    void updatePowerSave( void );
+
+    /*!
+     * @brief Get whether the power save deadline applies
+     *
+     * @return true When radio is in power save mode
+     * @return false Otherwise
+     */
+    bool powerSave( void ) const{ return power_save_; };
+
+    /*!
+     * @brief Get statistics
+     *
+     * @return const Statistics& Statistics
+     */
+    const Statistics& statistics( void ) const{ return statistics_; };
+
+    /*!
+     * @brief Get messages per frame in percent
+     *
+     * @return uint32_t Batching factor times 100
+     */
+    uint32_t batchingFactorPercent( void ) const;
+
+    /*!
+     * @brief Get mean time a message waited in a frame
+     *
+     * @return uint32_t Added latency in microseconds
+     */
+    uint32_t meanLatencyUs( void ) const;
+
+    /*!
+     * @brief Print statistics as one line of key=value pairs
+     *
+     */
+    void print( void ) const;
+
+
+    private:
+
+    uint8_t frame_[frame_size];                     /*!<Frame being filled*/
+    uint16_t length_;                               /*!<Bytes in frame*/
+    uint16_t messages_;                             /*!<Messages in frame*/
+    uint64_t first_added_;                          /*!<Time first message was added to frame*/
+    uint64_t added_sum_;                            /*!<Sum of times messages were added relative to first one*/
+
+    uint32_t max_age_ms_;                           /*!<Age deadline while radio is awake*/
+    uint32_t power_save_max_age_ms_;                /*!<Age deadline in power save mode*/
+    uint16_t flush_threshold_;                      /*!<Frame size that triggers sending*/
+    bool power_save_;                               /*!<Radio is in power save mode*/
+
+    TcpConnection* connection_;                     /*!<TCP destination*/
+    UdpEndpoint* endpoint_;                         /*!<UDP destination*/
+    ip_addr_t address_;                             /*!<UDP destination address*/
+    uint16_t port_;                                 /*!<UDP destination port*/
+
+    Statistics statistics_;                         /*!<Statistics*/
+
+    async_when_pending_worker_t link_worker_;       /*!<Reads power save mode in lwIP context after link up*/
+    async_at_time_worker_t age_worker_;             /*!<Sends frame at age deadline*/
+
+
+    /*!
+     * @brief Send frame without locking
+     *
+     * @param reason Reason for sending
+     * @return int 0 on success or when frame is empty, lwIP error code otherwise
+     */
+    int send( const FlushReason reason );
+
+    /*!
+     * @brief Start age deadline of frame
+     *
+     */
+    void scheduleAge( void );
+
+    /*!
+     * @brief Link callback of WiFiStation
+     *
+     */
+    static void linkChanged( void* user_data, const bool link_up );
+
+    /*!
+     * @brief Link worker in lwIP context
+     *
+     */
+    static void linkWork( async_context_t* context, async_when_pending_worker_t* worker );
+
+    /*!
+     * @brief Age worker in lwIP context
+     *
+     */
+    static void ageWork( async_context_t* context, async_at_time_worker_t* worker );
+
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef WIFICHANNELANALYTICS_H
+#define WIFICHANNELANALYTICS_H
+
+/*!
+ * @file wiFiChannelAnalytics.h
+ * @author janwolzenburg
+ * @brief Class definition of ChannelAnalytics
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <vector>
+using std::vector;
+
+#include "pico/cyw43_arch.h"
+
+
+/*!
+ * @brief Per channel occupancy statistics from scan results
+ * @details Accumulates access point counts, RSSI histograms and an interference estimate over one or more scans.
+ *          Needs no heap. Access points heard more than once in a scan are counted once
+ */
+class ChannelAnalytics{
+
+    public:
+
+    static constexpr uint8_t max_channel = 14;          /*!<Highest 2.4 GHz channel*/
+    static constexpr uint8_t rssi_bins = 6;             /*!<Number of RSSI histogram bins*/
+    static constexpr int8_t rssi_bin_floor = -90;       /*!<Upper edge of lowest bin in dBm*/
+    static constexpr int8_t rssi_bin_width = 10;        /*!<Width of RSSI bins in dBm*/
+    static constexpr size_t max_unique_per_scan = 64;   /*!<Access points tracked exactly for duplicate detection per scan*/
+    static constexpr size_t bssid_filter_bits = 1024;   /*!<Size of the hash filter for access points beyond max_unique_per_scan*/
+    static constexpr uint16_t max_scans = 4096;         /*!<Scans accumulated before the history is halved*/
+
+    /*!
+     * @brief Occupancy of one channel
+     * @details Counts are averaged over all scans as 1/16 access points. Interference weighs every access point
+     *          on overlapping channels by its received power relative to -90 dBm
+     *
+     */
+    struct Channel{
+        uint16_t access_points;             /*!<Access points on channel in 1/16 per scan*/
+        uint16_t rssi_histogram[rssi_bins]; /*!<Access points per RSSI bin, total over accumulated scans. Bin 0 below -90 dBm, last above -50 dBm*/
+        int8_t strongest_rssi;              /*!<Strongest RSSI heard on channel in dBm since the history was last halved. INT8_MIN when empty*/
+        int8_t mean_rssi;                   /*!<Mean RSSI on channel in dBm. INT8_MIN when empty*/
+        uint16_t interference;              /*!<Interference estimate. 0 is a clean channel*/
+    };
+
+    /*!
+     * @brief Occupancy of all channels
+     *
+     */
+    struct Report{
+        uint16_t scans;                     /*!<Number of scans accumulated. Halved when reaching max_scans or when a histogram bin fills up*/
+        uint16_t access_points;             /*!<Access points per scan in 1/16*/
+        uint8_t least_interfered_channel;   /*!<Channel with lowest interference among 1, 6 and 11*/
+        uint16_t filtered_access_points;    /*!<Access points of last scan beyond max_unique_per_scan. Deduplicated by a hash filter, which drops a few*/
+        Channel channels[max_channel + 1];  /*!<Occupancy per channel. Index is channel number, 0 unused*/
+    };
+
+    /*!
+     * @brief Constructor
+     *
+     */
+    ChannelAnalytics( void );
+
+    /*!
+     * @brief Start accumulating a scan
+     *
+     */
+    void beginScan( void );
+
+    /*!
+     * @brief Add one scan result
+     *
+     * @param result Scan result
+     */
+    void addResult( const cyw43_ev_scan_result_t& result );
+
+    /*!
+     * @brief Finish scan and update report
+     *
+     */
+    void endScan( void );
+
+    /*!
+     * @brief Add all results of one complete scan
+     *
+     * @param results Results as returned by WiFiStation::getAvailableWifis()
+     */
+    void addScan( const vector<cyw43_ev_scan_result_t>& results );
+
+    /*!
+     * @brief Get report
+     *
+     * @return const Report& Report of all finished scans
+     */
+    const Report& report( void ) const{ return report_; };
+
+    /*!
+     * @brief Get interference estimate of channel from report
+     *
+     * @param channel Channel
+     * @return uint16_t Interference. UINT16_MAX for invalid channels
+     */
+    uint16_t interference( const uint8_t channel ) const;
+
+    /*!
+     * @brief Get interference estimate of channel from current scan
+     * @details Valid during a scan for the results added so far
+     *
+     * @param channel Channel
+     * @return uint16_t Interference. UINT16_MAX for invalid channels
+     */
+    uint16_t currentInterference( const uint8_t channel ) const;
+
+    /*!
+     * @brief Forget all scans
+     *
+     */
+    void clear( void );
+
+    /*!
+     * @brief Print report
+     *
+     */
+    void print( void ) const;
+
+
+    private:
+
+    Report report_;                                     /*!<Report of finished scans*/
+    uint32_t access_point_total_[max_channel + 1];      /*!<Access points per channel over all scans*/
+    int32_t rssi_sum_[max_channel + 1];                 /*!<Sum of RSSI per channel over all scans*/
+    uint32_t interference_sum_[max_channel + 1];        /*!<Interference per channel over all scans*/
+
+    uint16_t scan_access_points_[max_channel + 1];      /*!<Access points per channel in current scan*/
+    uint16_t scan_power_[max_channel + 1];              /*!<Received power per channel in current scan*/
+    uint8_t scan_bssids_[max_unique_per_scan][6];       /*!<Access points heard in current scan*/
+    size_t scan_bssid_count_;                           /*!<Number of access points heard in current scan*/
+    uint8_t scan_bssid_filter_[bssid_filter_bits / 8];  /*!<Hash filter of access points heard in current scan once scan_bssids_ is full*/
+    uint16_t scan_filtered_count_;                      /*!<Access points added through the hash filter in current scan*/
+    int8_t scan_strongest_[max_channel + 1];            /*!<Strongest RSSI per channel in current scan*/
+    bool histogram_full_;                               /*!<A histogram bin reached half its range*/
+
+
+    /*!
+     * @brief Interference on channel from per channel power
+     *
+     * @param power Received power per channel
+     * @param channel Channel
+     * @return uint16_t Interference
+     */
+    static uint16_t interferenceFromPower( const uint16_t power[max_channel + 1], const uint8_t channel );
+
+    /*!
+     * @brief Add access point to the hash filter of the current scan
+     * @details Two bits per access point. False positives count a new access point as already heard
+     *
+     * @param bssid MAC address
+     * @return true When the access point was not in the filter
+     * @return false When it probably was
+     */
+    bool addToFilter( const uint8_t bssid[6] );
+
+};
+
+#endif
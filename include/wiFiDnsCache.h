@@ -0,0 +1,216 @@
+#ifndef WIFIDNSCACHE_H
+#define WIFIDNSCACHE_H
+
+/*!
+ * @file wiFiDnsCache.h
+ * @author janwolzenburg
+ * @brief Class definition of DnsCache
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
+#include "lwip/ip_addr.h"
+#include "lwip/dns.h"
+
+
+/*!
+ * @brief Fixed size DNS cache surviving link flaps
+ * @details Entries are refreshed through lwIP's resolver, which answers from its own table while the record's TTL
+ *          is valid and queries the server once it expired. Stale entries are served while a refresh is in flight.
+ *          Hostnames added with addPrefetch() are resolved as soon as the station's link comes up.
+ *          Public methods take the lwIP lock, which nests, so they also work from lwIP callbacks
+ */
+class DnsCache{
+
+    public:
+
+    static constexpr size_t max_entries = 8;                /*!<Number of cached hostnames*/
+    static constexpr size_t max_hostname_length = 63;       /*!<Maximum hostname length*/
+    static constexpr size_t max_waiters = 4;                /*!<Callers per hostname waiting for a resolution*/
+    static constexpr size_t max_caches = 4;                 /*!<Caches that can exist at the same time*/
+
+    /*!
+     * @brief Callback when a hostname is resolved
+     * @details Called in lwIP context. address is nullptr when resolution failed
+     *
+     */
+    typedef void (*resolved_callback_t)( void* user_data, const char* hostname, const ip_addr_t* address );
+
+    /*!
+     * @brief Constructor. Registers for link changes
+     * @details Registers through WiFiStation::addLinkWorker(). At most max_caches caches can exist. Further ones never resolve
+     *
+     * @param refresh_interval_ms Age after which an entry is refreshed through lwIP
+     */
+    DnsCache( const uint32_t refresh_interval_ms = 60000 );
+
+    /*!
+     * @brief Destructor. Unregisters from link changes
+     * @details lwIP cannot cancel queries. Answers to queries in flight are dropped
+     *
+     */
+    ~DnsCache( void );
+
+    /*!
+     * @brief No copy contructor
+     *
+     */
+    DnsCache( const DnsCache& cache ) = delete;
+
+    /*!
+     * @brief Copy assignment deleted
+     *
+     */
+    DnsCache& operator=( const DnsCache& cache ) = delete;
+
+    /*!
+     * @brief Add hostname to resolve on every link up
+     *
+     * @param hostname Hostname
+     * @return int 0 on success
+     */
+    int addPrefetch( const char* const hostname );
+
+    /*!
+     * @brief Resolve hostname
+     * @details Returns cached address right away, also when it is stale. A stale or missing entry starts a refresh.
+     *          When no address is cached the callback is called once the refresh finished. Up to max_waiters callers
+     *          per hostname can wait at the same time, further ones get -1
+     *
+     * @param hostname Hostname
+     * @param address Resolved address when returning 0
+     * @param callback Callback for pending resolution. May be nullptr
+     * @param user_data Passed to callback
+     * @return int 0 when address is valid, 1 when resolution is pending, -1 on error or when too many callers wait
+     */
+    int resolve( const char* const hostname, ip_addr_t& address, const resolved_callback_t callback = nullptr, void* const user_data = nullptr );
+
+    /*!
+     * @brief Refresh all prefetch entries that are stale
+     * @details Called on link up. Can be called manually
+     *
+     */
+    void prefetch( void );
+
+    /*!
+     * @brief Forget all entries except the prefetch hostnames
+     *
+     */
+    void clear( void );
+
+    /*!
+     * @brief Get number of answers from cache
+     *
+     * @return uint32_t Number of hits
+     */
+    uint32_t hits( void ) const{ return hits_; };
+
+    /*!
+     * @brief Get number of answers served stale while refreshing
+     *
+     * @return uint32_t Number of stale hits
+     */
+    uint32_t staleHits( void ) const{ return stale_hits_; };
+
+    /*!
+     * @brief Get number of lookups without cached address
+     *
+     * @return uint32_t Number of misses
+     */
+    uint32_t misses( void ) const{ return misses_; };
+
+
+    private:
+
+    /*!
+     * @brief Caller waiting for a resolution
+     *
+     */
+    struct waiter_t{
+        resolved_callback_t callback;               /*!<Callback*/
+        void* user_data;                            /*!<User data for callback*/
+    };
+
+    /*!
+     * @brief Cache entry
+     *
+     */
+    struct entry_t{
+        char hostname[max_hostname_length + 1];     /*!<Hostname. Empty when unused*/
+        ip_addr_t address;                          /*!<Cached address*/
+        bool valid;                                 /*!<Address is valid*/
+        bool prefetch;                              /*!<Resolve on link up*/
+        bool in_flight;                             /*!<Refresh is running*/
+        uint64_t resolved_at;                       /*!<Time of last successful resolution*/
+        uint64_t last_used;                         /*!<Time of last lookup*/
+        waiter_t waiters[max_waiters];              /*!<Waiting callers*/
+        size_t waiter_count;                        /*!<Number of waiting callers*/
+    };
+
+    entry_t entries_[max_entries];                  /*!<Entries*/
+    uint64_t refresh_interval_us_;                  /*!<Age after which an entry is refreshed*/
+    async_when_pending_worker_t prefetch_worker_;   /*!<Runs prefetch in lwIP context after link up*/
+    uint32_t hits_;                                 /*!<Fresh cache hits*/
+    uint32_t stale_hits_;                           /*!<Stale cache hits*/
+    uint32_t misses_;                               /*!<Cache misses*/
+    DnsCache** registration_;                       /*!<Slot in registry_ passed to lwIP. nullptr when none was free*/
+
+    static DnsCache* registry_[max_caches];         /*!<Existing caches. Outlives queries in flight*/
+
+
+    /*!
+     * @brief Find entry
+     *
+     * @param hostname Hostname
+     * @return entry_t* Entry or nullptr
+     */
+    entry_t* find( const char* const hostname );
+
+    /*!
+     * @brief Find entry or take a free or the least recently used one
+     *
+     * @param hostname Hostname
+     * @return entry_t* Entry or nullptr when all entries are prefetch entries
+     */
+    entry_t* findOrAllocate( const char* const hostname );
+
+    /*!
+     * @brief Start refresh of entry without locking
+     *
+     * @param entry Entry
+     */
+    void refresh( entry_t& entry );
+
+    /*!
+     * @brief Store result and notify waiting caller
+     *
+     * @param entry Entry
+     * @param address Resolved address or nullptr on failure
+     */
+    void complete( entry_t& entry, const ip_addr_t* const address );
+
+    /*!
+     * @brief Link callback of WiFiStation
+     *
+     */
+    static void linkChanged( void* user_data, const bool link_up );
+
+    /*!
+     * @brief Prefetch worker in lwIP context
+     *
+     */
+    static void prefetchWork( async_context_t* context, async_when_pending_worker_t* worker );
+
+    /*!
+     * @brief lwIP resolver callback
+     * @details argument is the slot in registry_, which is cleared when the cache is destroyed
+     *
+     */
+    static void found( const char* hostname, const ip_addr_t* address, void* argument );
+
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef WIFILINKQUALITY_H
+#define WIFILINKQUALITY_H
+
+/*!
+ * @file wiFiLinkQuality.h
+ * @author janwolzenburg
+ * @brief Class definition of LinkQuality
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pico/async_context.h"
+#include "wiFiTransport.h"
+
+
+/*!
+ * @brief Signal strength and transmit errors of the connected station
+ * @details Samples the RSSI of the associated access point through cyw43_wifi_get_rssi() while the station is connected.
+ *          Samples are smoothed with an exponentially weighted moving average. Minimum and maximum cover the current
+ *          and the previous window of samples. Transmit retransmissions and errors are read from the firmware counters
+ *          with every sample. Send counters of registered UdpEndpoint and TcpConnection objects are summed up
+ */
+class LinkQuality{
+
+    public:
+
+    static constexpr int32_t average_scale = 16;        /*!<Fixed point scale of the average*/
+    static constexpr int32_t average_weight = 8;        /*!<New samples count 1/average_weight into the average*/
+    static constexpr int16_t alarm_hysteresis = 3;      /*!<Rise of average in dBm above threshold that clears the alarm*/
+    static constexpr size_t max_sources = 8;            /*!<Transport objects that can be registered*/
+
+    /*!
+     * @brief Callback when the average crosses the alarm threshold
+     * @details Called in lwIP context
+     *
+     */
+    typedef void (*alarm_callback_t)( void* user_data, const bool degraded, const int16_t average_rssi );
+
+    /*!
+     * @brief Link quality at one point in time
+     *
+     */
+    struct Sample{
+        int16_t rssi;                   /*!<Last RSSI in dBm*/
+        int16_t average;                /*!<Smoothed RSSI in dBm*/
+        int16_t minimum;                /*!<Lowest RSSI of the last two windows in dBm*/
+        int16_t maximum;                /*!<Highest RSSI of the last two windows in dBm*/
+        uint32_t samples;               /*!<Number of samples taken*/
+        uint32_t read_failures;         /*!<Failed RSSI reads*/
+        uint32_t tx_retransmits;        /*!<Retransmissions of the radio since driver start*/
+        uint32_t tx_errors;             /*!<Transmit errors of the radio since driver start*/
+        uint32_t counter_read_failures; /*!<Failed or unsupported reads of firmware counters*/
+        uint32_t sends;                 /*!<Sends of registered transport objects*/
+        uint32_t send_failures;         /*!<Failed sends of registered transport objects*/
+        uint32_t flush_failures;        /*!<Failed flushes of registered transport objects*/
+        uint64_t updated_us;            /*!<Time of last sample. 0 when none was taken*/
+        bool degraded;                  /*!<Average is below alarm threshold*/
+    };
+
+    /*!
+     * @brief Start sampling
+     * @details Call after WiFiStation::initialise(). Samples are taken while the station is connected.
+     *          The average restarts with the first sample after every link up
+     *
+     * @param interval_ms Sample interval
+     * @param window Samples per minimum and maximum window
+     * @return int 0 on success
+     */
+    static int start( const uint32_t interval_ms = 1000, const uint32_t window = 60 );
+
+    /*!
+     * @brief Stop sampling
+     *
+     */
+    static void stop( void );
+
+    /*!
+     * @brief Get current link quality
+     * @details Copies a few bytes with interrupts disabled. Can be called from any context
+     *
+     * @return Sample Link quality
+     */
+    static Sample sample( void );
+
+    /*!
+     * @brief Set alarm for a low average
+     *
+     * @param threshold_dbm Average RSSI below which the link counts as degraded
+     * @param callback Callback. nullptr to disable
+     * @param user_data Passed to callback
+     */
+    static void setAlarm( const int16_t threshold_dbm, const alarm_callback_t callback, void* const user_data );
+
+    /*!
+     * @brief Add send counters of endpoint to the sample
+     *
+     * @param endpoint Endpoint. Remove it before it is destroyed
+     * @return int 0 on success, -1 when max_sources are registered
+     */
+    static int addSource( const UdpEndpoint* const endpoint ){ return addCounters( &endpoint->sendCounters() ); };
+
+    /*!
+     * @brief Add send counters of connection to the sample
+     *
+     * @param connection Connection. Remove it before it is destroyed
+     * @return int 0 on success, -1 when max_sources are registered
+     */
+    static int addSource( const TcpConnection* const connection ){ return addCounters( &connection->sendCounters() ); };
+
+    /*!
+     * @brief Remove endpoint added with addSource()
+     *
+     * @param endpoint Endpoint
+     */
+    static void removeSource( const UdpEndpoint* const endpoint ){ removeCounters( &endpoint->sendCounters() ); };
+
+    /*!
+     * @brief Remove connection added with addSource()
+     *
+     * @param connection Connection
+     */
+    static void removeSource( const TcpConnection* const connection ){ removeCounters( &connection->sendCounters() ); };
+
+    /*!
+     * @brief Print link quality as one line of key=value pairs
+     *
+     */
+    static void print( void );
+
+
+    private:
+
+    static Sample sample_;                          /*!<Current link quality*/
+    static int32_t average_;                        /*!<Average scaled by average_scale*/
+    static int16_t window_minimum_[2];              /*!<Minimum of previous and current window*/
+    static int16_t window_maximum_[2];              /*!<Maximum of previous and current window*/
+    static uint32_t window_samples_;                /*!<Samples in current window*/
+    static uint32_t window_;                        /*!<Samples per window*/
+    static uint32_t interval_ms_;                   /*!<Sample interval*/
+    static bool running_;                           /*!<Sampling started*/
+    static bool first_after_link_up_;               /*!<Next sample starts the average*/
+
+    static int16_t alarm_threshold_;                /*!<Alarm threshold in dBm*/
+    static alarm_callback_t alarm_callback_;        /*!<Alarm callback*/
+    static void* alarm_user_data_;                  /*!<User data for alarm callback*/
+
+    static const SendCounters* sources_[max_sources];   /*!<Send counters of registered transport objects*/
+
+    static async_at_time_worker_t sample_worker_;   /*!<Takes samples*/
+
+
+    /*!
+     * @brief Read RSSI and update statistics
+     *
+     */
+    static void takeSample( void );
+
+    /*!
+     * @brief Read transmit counters of the firmware into sample_
+     *
+     */
+    static void readCounters( void );
+
+    /*!
+     * @brief Register send counters
+     *
+     * @param counters Counters
+     * @return int 0 on success, -1 when no slot is free
+     */
+    static int addCounters( const SendCounters* const counters );
+
+    /*!
+     * @brief Unregister send counters
+     *
+     * @param counters Counters
+     */
+    static void removeCounters( const SendCounters* const counters );
+
+    /*!
+     * @brief Link callback of WiFiStation
+     *
+     */
+    static void linkChanged( void* user_data, const bool link_up );
+
+    /*!
+     * @brief Sample worker in lwIP context
+     *
+     */
+    static void sampleWork( async_context_t* context, async_at_time_worker_t* worker );
+
+};
+
+#endif
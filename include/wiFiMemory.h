@@ -0,0 +1,63 @@
+#ifndef WIFIMEMORY_H
+#define WIFIMEMORY_H
+
+/*!
+ * @file wiFiMemory.h
+ * @author janwolzenburg
+ * @brief Class definition of MemoryReport
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*!
+ * @brief Memory usage of WiFiStation, the heap and lwIP
+ * @details lwIP numbers need WIFI_LWIP_MEMORY_STATS set to 1 in lwipopts.h. Otherwise they are 0.
+ *          With MEM_LIBC_MALLOC the lwIP heap is part of the C heap
+ */
+class MemoryReport{
+
+    public:
+
+    /*!
+     * @brief Memory usage at one point in time
+     *
+     */
+    struct Usage{
+        size_t library_heap;            /*!<Heap held by WiFiStation in bytes*/
+        size_t library_heap_peak;       /*!<Highest heap held by WiFiStation in bytes*/
+        size_t scan_results;            /*!<Entries in scan table*/
+
+        size_t heap_used;               /*!<C heap in use in bytes*/
+        size_t heap_reserved;           /*!<C heap taken from RAM in bytes. Never shrinks, so it is the heap high watermark*/
+
+        size_t lwip_heap_used;          /*!<lwIP heap in use in bytes*/
+        size_t lwip_heap_peak;          /*!<Highest lwIP heap use in bytes*/
+        size_t lwip_pool_used;          /*!<Bytes in use in all lwIP pools*/
+        size_t lwip_pool_peak;          /*!<Sum of highest use of every lwIP pool in bytes*/
+        size_t lwip_pool_size;          /*!<Bytes of all lwIP pools*/
+        uint32_t lwip_failures;         /*!<Failed lwIP heap and pool allocations*/
+    };
+
+    /*!
+     * @brief Get current usage
+     * @details Takes the lwIP lock
+     *
+     * @return Usage Usage
+     */
+    static Usage usage( void );
+
+    /*!
+     * @brief Print usage as one line of key=value pairs
+     * @details With lwIP statistics one line per pool follows
+     *
+     */
+    static void print( void );
+
+};
+
+#endif
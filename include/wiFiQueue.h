@@ -0,0 +1,230 @@
+#ifndef WIFIQUEUE_H
+#define WIFIQUEUE_H
+
+/*!
+ * @file wiFiQueue.h
+ * @author janwolzenburg
+ * @brief Class definition of OutboundQueue
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
+#include "lwip/tcp.h"
+#include "wiFiTransport.h"
+
+
+/*!
+ * @brief Bounded store-and-forward queue for outgoing messages
+ * @details Messages are copied into a buffer given by the application. Enqueueing never allocates or blocks and works
+ *          in any link state. While the station is connected the queue drains in batches of up to one MSS of
+ *          concatenated messages into a sink, limited by a token bucket. Messages should be self-delimiting
+ *          because batches do not keep their boundaries.
+ *          Optionally the oldest bytes move to a flash region when the buffer is more than half full, so outages
+ *          longer than the buffer lasts do not lose data. Flash contents do not survive a reset.
+ *          enqueue() may be called from any context on the core running the async context
+ */
+class OutboundQueue{
+
+    public:
+
+    static constexpr uint16_t max_batch_size = TCP_MSS;             /*!<Largest batch and message in bytes*/
+    static constexpr uint32_t retry_interval_ms = 10;               /*!<Delay after a batch was not taken*/
+    static constexpr size_t max_spill_pages = 16;                   /*!<Flash pages written per worker run*/
+
+    /*!
+     * @brief Sink for batches
+     * @details Called in lwIP context. Must copy the data
+     *
+     * @return int 0 when batch was taken. Otherwise it is offered again later
+     */
+    typedef int (*sink_t)( void* user_data, const uint8_t* data, uint16_t length );
+
+    /*!
+     * @brief Queue statistics
+     *
+     */
+    struct Statistics{
+        uint32_t enqueued;              /*!<Messages accepted*/
+        uint32_t dropped;               /*!<Messages rejected because queue was full*/
+        uint32_t batches;               /*!<Batches taken by sink*/
+        uint32_t sent;                  /*!<Messages taken by sink*/
+        uint32_t sink_busy;             /*!<Batches refused by sink*/
+        uint32_t spilled_pages;         /*!<Pages written to flash*/
+        size_t peak;                    /*!<Highest number of queued bytes in buffer and flash*/
+    };
+
+    /*!
+     * @brief Constructor. Registers for link changes
+     *
+     * @param buffer Buffer for queued messages. Each message takes two bytes more than its length
+     * @param size Buffer size
+     * @param rate Drain rate in bytes per second
+     * @param burst Bytes that can be sent at once after the queue was idle. At least one batch
+     */
+    OutboundQueue( uint8_t* const buffer, const size_t size, const uint32_t rate = 32768, const uint32_t burst = 2 * TCP_MSS );
+
+    /*!
+     * @brief Destructor. Unregisters from link changes. Queued messages are lost
+     *
+     */
+    ~OutboundQueue( void );
+
+    /*!
+     * @brief No copy contructor
+     *
+     */
+    OutboundQueue( const OutboundQueue& queue ) = delete;
+
+    /*!
+     * @brief Copy assignment deleted
+     *
+     */
+    OutboundQueue& operator=( const OutboundQueue& queue ) = delete;
+
+    /*!
+     * @brief Set sink for batches
+     *
+     * @param sink Sink. nullptr to hold messages
+     * @param user_data Passed to sink
+     */
+    void setSink( const sink_t sink, void* const user_data );
+
+    /*!
+     * @brief Use flash region for overflow
+     * @details Region must lie behind the program image. Erasing a sector blocks the async context and interrupts for
+     *          tens of milliseconds and core 1 must not execute from flash meanwhile. Only call while the queue is empty
+     *
+     * @param offset Offset of region from start of flash. Multiple of FLASH_SECTOR_SIZE
+     * @param size Size of region. Multiple of FLASH_SECTOR_SIZE
+     * @return int 0 on success
+     */
+    int setFlashOverflow( const uint32_t offset, const uint32_t size );
+
+    /*!
+     * @brief Queue copy of message
+     *
+     * @param data Message
+     * @param length Message length. At most max_batch_size
+     * @return int 0 on success, -1 when queue is full or message too long
+     */
+    int enqueue( const void* const data, const uint16_t length );
+
+    /*!
+     * @brief Get queued bytes in buffer and flash including message headers
+     *
+     * @return size_t Queued bytes
+     */
+    size_t queued( void ) const;
+
+    /*!
+     * @brief Get statistics
+     *
+     * @return const Statistics& Statistics
+     */
+    const Statistics& statistics( void ) const{ return statistics_; };
+
+    /*!
+     * @brief Sink writing batches to a TCP connection
+     * @details user_data must point to the TcpConnection or the TcpConnection of a TcpSession
+     *
+     */
+    static int connectionSink( void* user_data, const uint8_t* data, uint16_t length );
+
+
+    private:
+
+    uint8_t* const buffer_;                         /*!<Ring buffer*/
+    const size_t size_;                             /*!<Size of ring buffer*/
+    volatile size_t head_;                          /*!<Offset of oldest byte in buffer*/
+    volatile size_t used_;                          /*!<Bytes in buffer*/
+
+    uint32_t flash_offset_;                         /*!<Offset of flash region*/
+    uint32_t flash_size_;                           /*!<Size of flash region. 0 when unused*/
+    volatile size_t flash_head_;                    /*!<Offset of oldest byte in flash region*/
+    volatile size_t flash_used_;                    /*!<Bytes in flash region*/
+
+    sink_t sink_;                                   /*!<Sink for batches*/
+    void* sink_user_data_;                          /*!<User data for sink*/
+
+    uint32_t rate_;                                 /*!<Drain rate in bytes per second*/
+    uint64_t burst_;                                /*!<Bucket size in byte microseconds per second*/
+    uint64_t tokens_;                               /*!<Tokens in byte microseconds per second*/
+    uint64_t refilled_at_;                          /*!<Time of last refill*/
+
+    uint8_t batch_[max_batch_size];                 /*!<Batch handed to sink*/
+    Statistics statistics_;                         /*!<Statistics*/
+
+    async_when_pending_worker_t drain_worker_;      /*!<Drains and spills in lwIP context*/
+    async_at_time_worker_t retry_worker_;           /*!<Wakes drain worker when tokens are refilled or sink is ready*/
+
+
+    /*!
+     * @brief Spill oldest buffer bytes to flash and send batches
+     *
+     */
+    void service( void );
+
+    /*!
+     * @brief Move oldest buffer pages to flash while buffer is more than half full
+     *
+     * @return true When more pages should be moved
+     * @return false Otherwise
+     */
+    bool spill( void );
+
+    /*!
+     * @brief Send batches while tokens last
+     *
+     * @return uint32_t Milliseconds until next try. 0 when queue is empty or not draining
+     */
+    uint32_t drain( void );
+
+    /*!
+     * @brief Copy bytes from queue without removing them
+     * @details Flash holds the oldest bytes, buffer the newer ones
+     *
+     * @param position Position relative to oldest queued byte
+     * @param destination Destination
+     * @param length Number of bytes
+     */
+    void peek( const size_t position, uint8_t* const destination, const size_t length ) const;
+
+    /*!
+     * @brief Remove oldest bytes from queue
+     *
+     * @param length Number of bytes
+     */
+    void consume( size_t length );
+
+    /*!
+     * @brief Update peak usage
+     *
+     */
+    void updatePeak( void );
+
+    /*!
+     * @brief Link callback of WiFiStation
+     *
+     */
+    static void linkChanged( void* user_data, const bool link_up );
+
+    /*!
+     * @brief Drain worker in lwIP context
+     *
+     */
+    static void drainWork( async_context_t* context, async_when_pending_worker_t* worker );
+
+    /*!
+     * @brief Retry worker in lwIP context
+     *
+     */
+    static void retryWork( async_context_t* context, async_at_time_worker_t* worker );
+
+};
+
+#endif
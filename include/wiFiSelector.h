@@ -0,0 +1,204 @@
+#ifndef WIFISELECTOR_H
+#define WIFISELECTOR_H
+
+/*!
+ * @file wiFiSelector.h
+ * @author janwolzenburg
+ * @brief Class definition of AccessPointSelector
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <string>
+using std::string;
+
+#include "pico/cyw43_arch.h"
+#include "wiFiChannelAnalytics.h"
+
+
+/*!
+ * @brief Scores access points from scan results and keeps the best ones
+ * @details Score combines RSSI smoothed over scans, authentification mode, channel congestion and past connect success.
+ *          Results are added one by one during a scan. The top candidates are kept sorted so best() is O(1) after endScan().
+ *          Candidates with unsupported authentification are never selected
+ */
+class AccessPointSelector{
+
+    public:
+
+    static constexpr size_t max_candidates = 32;    /*!<Access points remembered across scans*/
+    static constexpr size_t top_k = 4;              /*!<Number of best candidates kept sorted*/
+    static constexpr uint8_t max_missed_scans = 3;  /*!<Scans a candidate may be missing before it is forgotten*/
+
+    /*!
+     * @brief Weights of the score components
+     * @details Each component is scaled to 0..100 before weighting
+     *
+     */
+    struct Weights{
+        uint8_t rssi = 4;               /*!<Smoothed signal strength*/
+        uint8_t authentification = 1;   /*!<Authentification mode. TKIP limits the link to legacy rates*/
+        uint8_t congestion = 2;         /*!<Interference from access points on overlapping channels*/
+        uint8_t history = 3;            /*!<Past connect success*/
+    };
+
+    /*!
+     * @brief One access point
+     *
+     */
+    struct Candidate{
+        uint8_t bssid[6];               /*!<MAC address*/
+        char ssid[33];                  /*!<Null terminated SSID*/
+        uint8_t channel;                /*!<Channel*/
+        uint8_t auth_mode;              /*!<Authentification mode as reported in scan*/
+        uint32_t authentification;      /*!<CYW43_AUTH_[...] type for connecting*/
+        int16_t rssi;                   /*!<Last RSSI in dBm*/
+        int32_t smoothed_rssi;          /*!<RSSI in 1/16 dBm smoothed across scans*/
+        uint16_t attempts;              /*!<Connect attempts*/
+        uint16_t successes;             /*!<Successful connects*/
+        uint8_t missed_scans;           /*!<Scans since last seen*/
+        bool seen;                      /*!<Seen in current scan*/
+        int32_t score;                  /*!<Current score*/
+    };
+
+    /*!
+     * @brief Constructor
+     *
+     * @param ssid Only consider access points of this network. Empty for all networks
+     * @param weights Weights of score components
+     */
+    AccessPointSelector( const string ssid, const Weights weights );
+
+    /*!
+     * @brief Constructor with default weights
+     *
+     * @param ssid Only consider access points of this network. Empty for all networks
+     */
+    AccessPointSelector( const string ssid = "" );
+
+    /*!
+     * @brief Prepare for results of a new scan
+     *
+     */
+    void beginScan( void );
+
+    /*!
+     * @brief Add one scan result
+     * @details Updates smoothed RSSI and the top candidates incrementally
+     *
+     * @param result Scan result
+     */
+    void addResult( const cyw43_ev_scan_result_t& result );
+
+    /*!
+     * @brief Finish scan
+     * @details Forgets access points not seen for some scans and rescores with final channel congestion
+     *
+     */
+    void endScan( void );
+
+    /*!
+     * @brief Report outcome of a connect attempt
+     *
+     * @param bssid MAC address of access point
+     * @param success True when connected
+     */
+    void reportConnectResult( const uint8_t bssid[6], const bool success );
+
+    /*!
+     * @brief Get best candidate
+     *
+     * @return const Candidate* Best candidate or nullptr when none is usable
+     */
+    const Candidate* best( void ) const{ return top_count_ > 0 ? &candidates_[top_[0]] : nullptr; };
+
+    /*!
+     * @brief Get best candidate of one network
+     * @details Searches all remembered access points, not only the top candidates
+     *
+     * @param ssid SSID of network
+     * @param authentification CYW43_AUTH_[...] type used for connecting
+     * @return const Candidate* Best candidate the station can join or nullptr when none is usable
+     */
+    const Candidate* best( const string& ssid, const uint32_t authentification ) const;
+
+    /*!
+     * @brief Get one of the best candidates
+     *
+     * @param rank 0 for best
+     * @return const Candidate* Candidate or nullptr when rank is out of range
+     */
+    const Candidate* top( const size_t rank ) const{ return rank < top_count_ ? &candidates_[top_[rank]] : nullptr; };
+
+    /*!
+     * @brief Get number of usable top candidates
+     *
+     * @return size_t Number of candidates
+     */
+    size_t topCount( void ) const{ return top_count_; };
+
+    /*!
+     * @brief Get number of remembered access points
+     *
+     * @return size_t Number of access points
+     */
+    size_t candidateCount( void ) const{ return candidate_count_; };
+
+    /*!
+     * @brief Get channel occupancy of all scans seen by the selector
+     *
+     * @return const ChannelAnalytics& Channel analytics
+     */
+    const ChannelAnalytics& channels( void ) const{ return channels_; };
+
+    /*!
+     * @brief Forget all access points and history
+     *
+     */
+    void clear( void );
+
+
+    private:
+
+    string ssid_;                                   /*!<Network filter*/
+    Weights weights_;                               /*!<Score weights*/
+    Candidate candidates_[max_candidates];          /*!<Remembered access points*/
+    size_t candidate_count_;                        /*!<Number of remembered access points*/
+    size_t top_[top_k];                             /*!<Indices of best candidates, best first*/
+    size_t top_count_;                              /*!<Number of best candidates*/
+    ChannelAnalytics channels_;                     /*!<Channel occupancy*/
+
+
+    /*!
+     * @brief Find candidate by MAC address
+     *
+     * @param bssid MAC address
+     * @return int Index or -1
+     */
+    int find( const uint8_t bssid[6] ) const;
+
+    /*!
+     * @brief Compute score of candidate
+     *
+     * @param candidate Candidate
+     * @return int32_t Score. INT32_MIN when unusable
+     */
+    int32_t score( const Candidate& candidate ) const;
+
+    /*!
+     * @brief Insert or move candidate in top list
+     *
+     * @param index Index of candidate
+     */
+    void updateTop( const size_t index );
+
+    /*!
+     * @brief Rebuild top list from all candidates
+     *
+     */
+    void rebuildTop( void );
+
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef WIFISESSION_H
+#define WIFISESSION_H
+
+/*!
+ * @file wiFiSession.h
+ * @author janwolzenburg
+ * @brief Class definition of TcpSession
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
+#include "lwip/ip_addr.h"
+#include "wiFiTransport.h"
+
+
+/*!
+ * @brief TCP client session that follows the station's link
+ * @details On link loss the connection is aborted right away instead of waiting for keepalive or retransmission timeouts.
+ *          When the station is connected again the session reconnects at once. Failed attempts and remote closes
+ *          are retried with exponential backoff while the link is up.
+ *          Handlers are the ones of TcpConnection and see every connect and disconnect of the session.
+ *          Public methods take the recursive lwIP lock and may be called from lwIP callbacks
+ */
+class TcpSession{
+
+    public:
+
+    /*!
+     * @brief Session statistics
+     *
+     */
+    struct Statistics{
+        uint32_t connects;                  /*!<Established connections*/
+        uint32_t link_aborts;               /*!<Connections aborted because the link was lost*/
+        uint32_t failures;                  /*!<Failed attempts and lost connections while the link was up*/
+        uint64_t last_outage_us;            /*!<Time from last loss of connection to reestablishment*/
+        uint64_t last_resume_us;            /*!<Time from last link up to reestablishment*/
+    };
+
+    /*!
+     * @brief Constructor. Registers for link changes
+     *
+     * @param backoff_initial_ms First retry delay after a failed attempt
+     * @param backoff_maximum_ms Maximum retry delay
+     */
+    TcpSession( const uint32_t backoff_initial_ms = 500, const uint32_t backoff_maximum_ms = 30000 );
+
+    /*!
+     * @brief Destructor. Unregisters from link changes and aborts connection
+     *
+     */
+    ~TcpSession( void );
+
+    /*!
+     * @brief No copy contructor
+     *
+     */
+    TcpSession( const TcpSession& session ) = delete;
+
+    /*!
+     * @brief Copy assignment deleted
+     *
+     */
+    TcpSession& operator=( const TcpSession& session ) = delete;
+
+    /*!
+     * @brief Set handlers
+     * @details See TcpConnection::setHandlers()
+     *
+     */
+    void setHandlers( const TcpConnection::receive_handler_t receive_handler, const TcpConnection::sent_handler_t sent_handler,
+                      const TcpConnection::state_handler_t state_handler, void* user_data );
+
+    /*!
+     * @brief Open session
+     * @details Connects right away when the station is connected and otherwise as soon as it is
+     *
+     * @param address Server address
+     * @param port Server port
+     * @return int 0 on success
+     */
+    int open( const ip_addr_t& address, const uint16_t port );
+
+    /*!
+     * @brief Close session gracefully. No reconnects afterwards
+     *
+     */
+    void close( void );
+
+    /*!
+     * @brief Get connection for writing
+     * @details Do not connect or close it directly
+     *
+     * @return TcpConnection& Connection
+     */
+    TcpConnection& connection( void ){ return connection_; };
+
+    /*!
+     * @brief Get whether connection is established
+     *
+     * @return true When established
+     * @return false Otherwise
+     */
+    bool connected( void ) const{ return connection_.connected(); };
+
+    /*!
+     * @brief Get whether session is open
+     *
+     * @return true When open
+     * @return false Otherwise
+     */
+    bool isOpen( void ) const{ return open_; };
+
+    /*!
+     * @brief Get statistics
+     *
+     * @return const Statistics& Statistics
+     */
+    const Statistics& statistics( void ) const{ return statistics_; };
+
+
+    private:
+
+    TcpConnection connection_;                      /*!<Managed connection*/
+    ip_addr_t address_;                             /*!<Server address*/
+    uint16_t port_;                                 /*!<Server port*/
+    bool open_;                                     /*!<Session is open*/
+    volatile bool link_up_;                         /*!<Station is connected*/
+    uint32_t backoff_initial_ms_;                   /*!<First retry delay*/
+    uint32_t backoff_maximum_ms_;                   /*!<Maximum retry delay*/
+    uint32_t backoff_ms_;                           /*!<Next retry delay*/
+    uint64_t lost_at_;                              /*!<Time connection was lost. 0 when not lost*/
+    uint64_t link_up_at_;                           /*!<Time of last link up*/
+    Statistics statistics_;                         /*!<Statistics*/
+
+    TcpConnection::receive_handler_t receive_handler_;  /*!<Application handler for received data*/
+    TcpConnection::sent_handler_t sent_handler_;        /*!<Application handler for acknowledged data*/
+    TcpConnection::state_handler_t state_handler_;      /*!<Application handler for state changes*/
+    void* user_data_;                                   /*!<User data for application handlers*/
+
+    async_when_pending_worker_t link_worker_;       /*!<Handles link changes in lwIP context*/
+    async_at_time_worker_t retry_worker_;           /*!<Retries connecting after backoff*/
+
+
+    /*!
+     * @brief Start connecting unless a connection exists
+     *
+     */
+    void attempt( void );
+
+    /*!
+     * @brief Schedule next attempt and double delay
+     *
+     */
+    void scheduleRetry( void );
+
+    /*!
+     * @brief Link callback of WiFiStation
+     *
+     */
+    static void linkChanged( void* user_data, const bool link_up );
+
+    /*!
+     * @brief Link worker in lwIP context
+     *
+     */
+    static void linkWork( async_context_t* context, async_when_pending_worker_t* worker );
+
+    /*!
+     * @brief Retry worker in lwIP context
+     *
+     */
+    static void retryWork( async_context_t* context, async_at_time_worker_t* worker );
+
+    static void received( void* user_data, struct pbuf* chain );
+    static void sent( void* user_data, uint16_t acknowledged );
+    static void stateChanged( void* user_data, bool connected, err_t error );
+
+};
+
+#endif
@@ -17,9 +17,14 @@ using std::vector;
 
 #include "pico/time.h"
 #include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
 
 
-#define DEBUG               // If defined debug messages will be printed
+#ifndef NO_DEBUG
+#define DEBUG               // If defined debug messages will be printed. Define NO_DEBUG to disable
+#endif
+
+class AccessPointSelector;
 
 // Max length of ssid
 constexpr size_t ssid_size = sizeof( cyw43_ev_scan_result_t::ssid );
@@ -31,13 +36,104 @@ constexpr size_t password_size = 63;
  * @brief Class to connect to a wifi as a station
  * @details Connect to one wifi network. When connection is lost - instance will retry to connect regularly.
  *          It should be possible to have more than one instance. But only one intstance can be connected.
- *          Reqiures one timer slot. Not tested with multithreading
+ *          The connection is driven by a table driven state machine. Every state has a deadline and an escalation
+ *          when it passes, so a join that hangs is left and retried with exponential backoff.
+ *          Not tested with multithreading
  */
 class WiFiStation{
 
     public:
 
     static uint32_t connection_check_interval_us;      /*!<Time in milliseconds to check connection status*/
+    static uint32_t join_check_interval_us;            /*!<Time in microseconds to check connection status while joining or waiting for IP*/
+
+    /*!
+     * @brief Callback for link changes
+     * @details Called from connection check in lwIP context, or from disconnect() in the caller's context
+     * 
+     */
+    typedef void (*link_callback_t)( void* user_data, const bool link_up );
+
+    /*!
+     * @brief Connection states
+     * 
+     */
+    enum class ConnectionState : uint8_t{
+        idle,           /*!<No station connecting or connected*/
+        joining,        /*!<Join started, not associated yet*/
+        no_ip,          /*!<Associated, waiting for DHCP*/
+        connected,      /*!<Link up with IP*/
+        backoff,        /*!<Left network after failure. Waiting before next join*/
+        count           /*!<Number of states*/
+    };
+
+    /*!
+     * @brief Action when a state's deadline passes
+     * 
+     */
+    enum class Escalation : uint8_t{
+        none,           /*!<No deadline*/
+        rejoin,         /*!<Leave and join again right away*/
+        backoff,        /*!<Leave and wait before joining again*/
+        join            /*!<Join again*/
+    };
+
+    /*!
+     * @brief What caused a transition
+     * 
+     */
+    enum class TransitionCause : uint8_t{
+        request,        /*!<connect(), disconnect() or stopConnecting()*/
+        link_status,    /*!<Link status reported by driver*/
+        timeout         /*!<Deadline of state passed*/
+    };
+
+    /*!
+     * @brief One state transition
+     * 
+     */
+    struct transition_t{
+        uint64_t time_us;               /*!<Time of transition*/
+        ConnectionState from;           /*!<Previous state*/
+        ConnectionState to;             /*!<New state*/
+        TransitionCause cause;          /*!<Cause*/
+        int8_t link_status;             /*!<Link status at transition*/
+    };
+
+    /*!
+     * @brief Callback for state transitions
+     * @details Called in the context of the transition
+     * 
+     */
+    typedef void (*transition_callback_t)( void* user_data, const transition_t& transition );
+
+    static constexpr size_t transition_trace_size = 16;     /*!<Number of transitions kept for getTransitions()*/
+
+    /*!
+     * @brief Stages of initialisation
+     * 
+     */
+    enum class InitStage : uint8_t{
+        none,           /*!<Not initialised*/
+        driver,         /*!<Driver and lwIP initialised. Chip not up*/
+        chip_up,        /*!<Firmware loaded and station mode enabled*/
+        connecting,     /*!<Connect of station given to startInitialise() started*/
+        connected,      /*!<Station given to startInitialise() got an IP*/
+        failed          /*!<Initialisation or connect start failed*/
+    };
+
+    /*!
+     * @brief Duration of the stages from initialisation to IP
+     * 
+     */
+    struct BootTiming{
+        uint64_t started_us;            /*!<Time initialisation started*/
+        uint32_t driver_us;             /*!<Driver and lwIP initialisation*/
+        uint32_t chip_us;               /*!<Firmware upload and station mode*/
+        uint32_t association_us;        /*!<Connect start to association*/
+        uint32_t dhcp_us;               /*!<Association to IP*/
+        uint32_t total_us;              /*!<Initialisation start to IP. 0 until connected*/
+    };
 
     /*!
      * @brief Constructor
@@ -89,6 +185,43 @@ class WiFiStation{
      */
     static int initialise( uint32_t country = CYW43_COUNTRY_WORLDWIDE);
 
+    /*!
+     * @brief Start initialisation of CYW43 and return before the chip is up
+     * @details Initialises the driver and lwIP. The firmware upload and station mode follow in the next poll() or,
+     *          in background builds, in the next finishInitialise(). The upload still blocks the CPU for its duration,
+     *          but the application can do its own work first and needs no round trip to connect.
+     *          When station is given it is connected as soon as the chip is up. Check progress with initStage()
+     * 
+     * @param country Your country. From cyw43_country.h
+     * @param station Station to connect. nullptr to only bring up the chip. Must outlive the initialisation
+     * @return int 0 when driver initialisation succeeded
+     */
+    static int startInitialise( uint32_t country = CYW43_COUNTRY_WORLDWIDE, WiFiStation* const station = nullptr );
+
+    /*!
+     * @brief Bring up chip after startInitialise() and start connect of its station
+     * @details Blocks for the firmware upload. Call from thread context, never from a worker or interrupt.
+     *          Called by poll() in polling builds. Does nothing when the chip is already up
+     * 
+     * @return int 0 when chip is up, -1 when initialisation was not started or failed
+     */
+    static int finishInitialise( void );
+
+    /*!
+     * @brief Get stage of initialisation
+     * 
+     * @return InitStage Stage
+     */
+    static InitStage initStage( void ){ return init_stage_; };
+
+    /*!
+     * @brief Get duration of initialisation stages
+     * @details Filled by initialise() and startInitialise(). Connect stages only with a station given to startInitialise()
+     * 
+     * @return const BootTiming& Timing
+     */
+    static const BootTiming& bootTiming( void ){ return boot_timing_; };
+
     /*!
      * @brief Disconnect and deinitialise CYW43
      * 
@@ -126,11 +259,181 @@ class WiFiStation{
     static uint32_t getAuthentificationFromScanResult( const uint8_t authentification_from_scan );
 
     /*!
-     * @brief Poll for changes. Call regularly
+     * @brief Check whether the CYW43 can connect with authentification type from scan result
+     * @details WEP only networks are not supported by the driver
+     * 
+     * @param authentification_from_scan Authentification type from scan
+     * @return true When supported
+     * @return false Otherwise
+     */
+    static bool isAuthentificationSupported( const uint8_t authentification_from_scan );
+
+    /*!
+     * @brief Check whether a station with the given authentification can join a network from a scan result
+     * @details Scan results of WPA2 networks map to mixed mode, which an AES only station joins as well
+     * 
+     * @param authentification CYW43_AUTH_[...] type of station
+     * @param authentification_from_scan Authentification type from scan
+     * @return true When compatible
+     * @return false Otherwise
+     */
+    static bool isAuthentificationCompatible( const uint32_t authentification, const uint8_t authentification_from_scan );
+
+    /*!
+     * @brief Feed results of following scans into selector
+     * @details Selector must outlive its registration. Joins go to the best access point of the station's network
+     *          known to the selector, and their outcome is reported back to it
+     * 
+     * @param selector Selector. nullptr to remove
+     */
+    static void setAccessPointSelector( AccessPointSelector* const selector );
+
+    /*!
+     * @brief Register callback for link up and link down of the connected station
+     * @details Takes the lwIP lock. Do not call from a link callback
+     * 
+     * @param callback Callback
+     * @param user_data Passed to callback
+     * @return int 0 on success
+     */
+    static int addLinkCallback( const link_callback_t callback, void* const user_data );
+
+    /*!
+     * @brief Remove callback registered with addLinkCallback()
+     * @details Takes the lwIP lock. Do not call from a link callback
+     * 
+     * @param callback Callback
+     * @param user_data User data it was registered with
+     */
+    static void removeLinkCallback( const link_callback_t callback, void* const user_data );
+
+    /*!
+     * @brief Register a link callback together with the worker it defers its work to
+     * @details Link callbacks run in the middle of a state transition, so they should only set the worker pending.
+     *          The worker runs once the transition finished. Needs the async context of the driver, so call it after
+     *          initialise(). Objects registering here cannot be constructed as globals. Takes the lwIP lock
+     * 
+     * @param worker Worker added to the async context of the driver
+     * @param callback Callback
+     * @param user_data Passed to callback
+     * @return int 0 on success, -1 when the driver is not initialised
+     */
+    static int addLinkWorker( async_when_pending_worker_t* const worker, const link_callback_t callback, void* const user_data );
+
+    /*!
+     * @brief Remove worker and callback registered with addLinkWorker()
+     * @details Takes the lwIP lock. Do not call from a link callback
+     * 
+     * @param worker Worker
+     * @param callback Callback
+     * @param user_data User data it was registered with
+     */
+    static void removeLinkWorker( async_when_pending_worker_t* const worker, const link_callback_t callback, void* const user_data );
+
+    /*!
+     * @brief Get current connection state
+     * 
+     * @return ConnectionState The state
+     */
+    static ConnectionState connectionState( void ){ return state_; };
+
+    /*!
+     * @brief Get name of state
+     * 
+     * @param state State
+     * @return const char* Name
+     */
+    static const char* stateName( const ConnectionState state );
+
+    /*!
+     * @brief Set deadline of a state
+     * @details Deadline of backoff is set with setBackoff(). Idle and connected have no deadline and are ignored
+     * 
+     * @param state State
+     * @param timeout_ms Time in milliseconds the state may last. 0 for no deadline
+     */
+    static void setStateTimeout( const ConnectionState state, const uint32_t timeout_ms );
+
+    /*!
+     * @brief Set backoff after failed joins
+     * @details Backoff doubles with every failed join up to the maximum and is reset when connected
+     * 
+     * @param initial_ms First backoff in milliseconds
+     * @param maximum_ms Maximum backoff in milliseconds
+     */
+    static void setBackoff( const uint32_t initial_ms, const uint32_t maximum_ms );
+
+    /*!
+     * @brief Set callback for state transitions
+     * 
+     * @param callback Callback. nullptr to remove
+     * @param user_data Passed to callback
+     */
+    static void setTransitionCallback( const transition_callback_t callback, void* const user_data );
+
+    /*!
+     * @brief Get last transitions
+     * 
+     * @param transitions Buffer for transitions, oldest first
+     * @param max_count Size of buffer
+     * @return size_t Number of transitions written
+     */
+    static size_t getTransitions( transition_t* const transitions, const size_t max_count );
+
+    /*!
+     * @brief Get heap held by the library
+     * @details Scan table, link callbacks and heap allocated credentials of the active station. Estimated from container capacities
+     * 
+     * @return size_t Bytes
+     */
+    static size_t heapInUse( void );
+
+    /*!
+     * @brief Get highest heap held by the library since initialise()
      * 
+     * @return size_t Bytes
      */
+    static size_t heapPeak( void ){ return heap_peak_; };
+
+    /*!
+     * @brief Get number of entries in scan table
+     * 
+     * @return size_t Number of scan results
+     */
+    static size_t scanResultCount( void ){ return available_wifis_.size(); };
+
+    /*!
+     * @brief Free the scan table
+     * @details The table keeps its capacity between scans. The next scan allocates it again
+     * 
+     */
+    static void releaseScanResults( void );
+
     #ifdef USE_POLLING
-    static void poll( void );
+    #ifdef USE_WATCHDOG
+    static constexpr uint64_t max_poll_wait_us = 500000;   /*!<Longest wait in pollBlocking(). Half the watchdog timeout*/
+    #else
+    static constexpr uint64_t max_poll_wait_us = 1000000;  /*!<Longest wait in pollBlocking()*/
+    #endif
+
+    /*!
+     * @brief Poll for changes. Call regularly
+     * @details Nothing needs to be done before the returned time unless the driver has work.
+     *          lwIP timers are handled by the driver and need not be considered
+     * 
+     * @return uint64_t Time in microseconds since boot of next connection check or state deadline. UINT64_MAX when none
+     */
+    static uint64_t poll( void );
+
+    /*!
+     * @brief Sleep until the next deadline or until the driver has work. Then poll
+     * @details Uses cyw43_arch_wait_for_work_until(). Application events from interrupts do not end the wait,
+     *          so limit the wait to the latency the application tolerates
+     * 
+     * @param max_wait_us Longest time to sleep in microseconds. Limited to max_poll_wait_us with watchdog
+     * @return uint64_t Time in microseconds since boot of next deadline as returned by poll()
+     */
+    static uint64_t pollBlocking( const uint64_t max_wait_us = max_poll_wait_us );
     #endif
 
     /*!
@@ -155,7 +458,7 @@ class WiFiStation{
      * @brief Connect this station to network
      * @details Does return directly. Check with connected() whether connection was successful
      * 
-     * @param is_reconnect Flag to indicate whether connection is a reconnect after connection lost
+     * @param is_reconnect Flag to indicate whether connection is a reconnect after connection lost. Keeps the current backoff
      * @return int 0 on successful start of connection process
      */
     int connect( const bool is_reconnect = false );
@@ -210,22 +513,119 @@ class WiFiStation{
     string ssid_;                   /*!<SSID of network*/
     string password_;               /*!<Password of network*/
     uint32_t authentification_;     /*!<CYW43 authentification type*/
-    bool connected_;                /*!<Flag if this station is connected*/
-    
-    static bool one_instance_connecting_;           /*!<Is one instance currently trying to connect*/
-    static bool one_instance_connected_;            /*!<Is one instance connected*/   
-    static int last_connection_state_;              /*!<Last connection status*/
-    static class WiFiStation* connected_station_;   /*!<Pointer to instance which is connecting or connected*/
+
+    /*!
+     * @brief Behaviour of one state
+     * 
+     */
+    struct state_config_t{
+        const char* name;               /*!<Name for debug output*/
+        uint32_t timeout_ms;            /*!<Deadline. 0 for none*/
+        Escalation escalation;          /*!<Action when deadline passed*/
+    };
+
+    static state_config_t state_table_[static_cast<size_t>( ConnectionState::count )];    /*!<Deadline and escalation per state*/
+    static const ConnectionState transition_table_[static_cast<size_t>( ConnectionState::count )][7];  /*!<Next state per state and link status*/
+
+    static ConnectionState state_;                  /*!<Current state*/
+    static uint64_t state_entered_;                 /*!<Time current state was entered*/
+    static int link_status_;                        /*!<Last link status*/
+    static class WiFiStation* active_station_;      /*!<Pointer to instance which is connecting or connected*/
+
+    static uint32_t backoff_initial_ms_;            /*!<First backoff*/
+    static uint32_t backoff_maximum_ms_;            /*!<Maximum backoff*/
+    static uint32_t backoff_ms_;                    /*!<Backoff for next failure*/
+    static uint32_t current_backoff_ms_;            /*!<Backoff of current backoff state*/
+
+    static transition_callback_t transition_callback_;              /*!<Callback for transitions*/
+    static void* transition_user_data_;                             /*!<User data for transition callback*/
+    static transition_t transitions_[transition_trace_size];        /*!<Ring of last transitions*/
+    static size_t transition_count_;                                /*!<Number of transitions recorded*/
+
+    static InitStage init_stage_;                   /*!<Stage of initialisation*/
+    static BootTiming boot_timing_;                 /*!<Duration of initialisation stages*/
+    static uint64_t stage_started_;                 /*!<Start of current initialisation stage*/
+    static WiFiStation* init_station_;              /*!<Station to connect after initialisation*/
 
     #ifdef USE_POLLING
     static uint64_t last_connection_check_;          /*!<Last time the connection state was checked*/
     static bool check_connection_;                  /*!<Flag for regularly checking connection*/    
+    static uint64_t next_deadline_;                 /*!<Next deadline returned by poll()*/
     #else
-    static repeating_timer_t connection_check_timer_;       /*!<Repeating timer for connection check*/
+    static async_at_time_worker_t connection_check_worker_;    /*!<Worker for connection check in lwIP context*/
     #endif
     
     static vector<cyw43_ev_scan_result_t> available_wifis_; /*!<Available networks*/
-    
+    static AccessPointSelector* selector_;                  /*!<Selector fed with scan results*/
+    static bool scan_pending_;                              /*!<Scan started but end not yet processed*/
+    static uint8_t join_bssid_[6];                          /*!<Access point of running join chosen by selector*/
+    static bool join_reported_;                             /*!<Outcome of join with join_bssid_ is reported*/
+
+    /*!
+     * @brief Registered link callback
+     * 
+     */
+    struct link_listener_t{
+        link_callback_t callback;       /*!<Callback*/
+        void* user_data;                /*!<User data for callback*/
+    };
+
+    static vector<link_listener_t> link_listeners_;         /*!<Callbacks for link changes*/
+    static size_t heap_peak_;                               /*!<Highest heap held by library*/
+
+    // Bits of the authentification type in scan results as set by the CYW43 driver
+    static constexpr uint8_t scan_auth_privacy = 0x01;     /*!<Privacy bit of capability field. Set for all encrypted networks*/
+    static constexpr uint8_t scan_auth_wpa = 0x02;         /*!<WPA information element present*/
+    static constexpr uint8_t scan_auth_wpa2 = 0x04;        /*!<RSN (WPA2) information element present*/
+
+
+    /*!
+     * @brief Process end of scan once
+     * @details Takes the lwIP lock. In background builds the connection check calls it when the scan is done
+     * 
+     */
+    static void finishScan( void );
+
+    /*!
+     * @brief Initialise driver and lwIP
+     * 
+     * @param country Country
+     * @return int 0 on success
+     */
+    static int startDriver( const uint32_t country );
+
+    /*!
+     * @brief Upload firmware and enable station mode. Blocks
+     * 
+     */
+    static void bringUpChip( void );
+
+    /*!
+     * @brief Bring up chip and start connect of init_station_
+     * 
+     */
+    static void advanceInitialise( void );
+
+    /*!
+     * @brief Record boot timing on state transitions
+     * 
+     * @param next New state
+     * @param now Time of transition
+     */
+    static void recordBootStage( const ConnectionState next, const uint64_t now );
+
+    /*!
+     * @brief Update heap peak after containers grew
+     * 
+     */
+    static void updateHeapPeak( void );
+
+    /*!
+     * @brief Call link callbacks
+     * 
+     * @param link_up True when link came up
+     */
+    static void notifyLink( const bool link_up );
 
     /*!
      * @brief Callback for network scan
@@ -254,19 +654,76 @@ class WiFiStation{
     static bool stopConnectionCheck( void );
 
     /*!
-     * @brief Timer callback for repeated connection check
+     * @brief Repeated connection check. Feeds link status and deadlines into the state machine
      * 
-     * @param timer Pointer to repeating timer (Only when using async)
      * @return true Always
      * @return false Never
      */
-    static bool checkConnection( 
-        #ifdef USE_POLLING
-            void
-        #else
-            repeating_timer_t* timer
-        #endif
-    );
+    static bool checkConnection( void );
+
+    #ifndef USE_POLLING
+    /*!
+     * @brief Worker for repeated connection check
+     * 
+     * @param context Async context of CYW43
+     * @param worker connection_check_worker_
+     */
+    static void connectionCheckWork( async_context_t* context, async_at_time_worker_t* worker );
+    #endif
+
+    /*!
+     * @brief Enter state
+     * @details Leaves the network when entering idle or backoff and calls transition and link callbacks
+     * 
+     * @param next New state
+     * @param cause Cause of transition
+     */
+    static void transition( const ConnectionState next, const TransitionCause cause );
+
+    /*!
+     * @brief Execute escalation of current state
+     * 
+     */
+    static void escalate( void );
+
+    /*!
+     * @brief Leave network and start joining the network of the active station
+     * 
+     * @return int 0 on success
+     */
+    static int startJoin( void );
+
+    /*!
+     * @brief Report outcome of join to access point chosen by selector
+     * @details Only the first outcome of every join is reported
+     * 
+     * @param success True when connected
+     */
+    static void reportJoin( const bool success );
+
+    /*!
+     * @brief Get interval of connection check in current state
+     * 
+     * @return uint64_t Interval in microseconds
+     */
+    static uint64_t checkIntervalUs( void );
+
+    /*!
+     * @brief Get deadline of current state
+     * 
+     * @return uint64_t Time in microseconds the current state may last. 0 for none
+     */
+    static uint64_t stateTimeoutUs( void );
+
+    #ifdef USE_POLLING
+    /*!
+     * @brief Get time of next connection check
+     * @details Earlier than the regular check when the deadline of the current state passes before
+     * 
+     * @return uint64_t Time in microseconds since boot. UINT64_MAX when check is stopped
+     */
+    static uint64_t nextConnectionCheck( void );
+    #endif
 
 };
 
@@ -0,0 +1,148 @@
+#ifndef WIFITRACE_H
+#define WIFITRACE_H
+
+/*!
+ * @file wiFiTrace.h
+ * @author janwolzenburg
+ * @brief Class definition of LinkTrace
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*!
+ * @brief Binary trace of link events in a fixed RAM ring
+ * @details WiFiStation records connect requests, connection checks, state transitions and scan results when built with USE_TRACE.
+ *          Consecutive connection checks with unchanged link status are merged into one record.
+ *          When the ring is full the oldest records are overwritten. Recording disables interrupts for a few cycles
+ */
+class LinkTrace{
+
+    public:
+
+    static constexpr size_t size = 256;         /*!<Number of records in ring*/
+
+    /*!
+     * @brief Record types
+     *
+     */
+    enum class Type : uint8_t{
+        connect = 1,        /*!<connect(). value is is_reconnect, data[0..3] authentification type*/
+        disconnect,         /*!<disconnect()*/
+        stop_connecting,    /*!<stopConnecting()*/
+        check,              /*!<Connection check. value is link status, data[0..3] number of checks, data[4..7] milliseconds to last check*/
+        transition,         /*!<State transition. value is new state, data[0] previous state, data[1] cause*/
+        scan_start,         /*!<Scan started. value is return code*/
+        scan_result,        /*!<Scan result. value is RSSI, data[0..5] MAC address, data[6] channel, data[7] authentification*/
+        scan_end            /*!<End of scan processed*/
+    };
+
+    /*!
+     * @brief One record. 16 bytes, little endian
+     *
+     */
+    struct record_t{
+        uint32_t time_low;      /*!<Lower 32 bits of time in microseconds since boot*/
+        uint16_t time_high;     /*!<Bits 32 to 47 of time*/
+        Type type;              /*!<Type of record*/
+        int8_t value;           /*!<Type specific value*/
+        uint8_t data[8];        /*!<Type specific data*/
+
+        /*!
+         * @brief Get time of record
+         *
+         * @return uint64_t Microseconds since boot
+         */
+        uint64_t time( void ) const{ return static_cast<uint64_t>( time_high ) << 32 | time_low; };
+    };
+
+    static_assert( sizeof( record_t ) == 16, "Trace records must be packed" );
+
+    /*!
+     * @brief Add record
+     *
+     * @param type Type
+     * @param value Value
+     * @param data Data. Copied up to 8 bytes. May be nullptr
+     * @param data_size Size of data
+     */
+    static void record( const Type type, const int8_t value, const void* const data = nullptr, const size_t data_size = 0 );
+
+    /*!
+     * @brief Add connection check
+     * @details Extends the last check record when link status did not change
+     *
+     * @param link_status Link status
+     */
+    static void recordCheck( const int link_status );
+
+    /*!
+     * @brief Get number of records in ring
+     *
+     * @return size_t Number of records
+     */
+    static size_t count( void );
+
+    /*!
+     * @brief Get number of records overwritten since last clear
+     *
+     * @return uint32_t Number of lost records
+     */
+    static uint32_t dropped( void ){ return dropped_; };
+
+    /*!
+     * @brief Copy records
+     *
+     * @param records Buffer for records, oldest first
+     * @param max_count Size of buffer
+     * @return size_t Number of records written
+     */
+    static size_t copy( record_t* const records, const size_t max_count );
+
+    /*!
+     * @brief Print all records as hex
+     * @details One line "TRACE <32 hex digits>" per record between "TRACE begin" and "TRACE end". Read by the host replay tool
+     *
+     */
+    static void dump( void );
+
+    /*!
+     * @brief Remove all records
+     *
+     */
+    static void clear( void );
+
+
+    private:
+
+    static record_t records_[size];     /*!<Ring of records*/
+    static size_t next_;                /*!<Index of next record*/
+    static size_t count_;               /*!<Number of records in ring*/
+    static uint32_t dropped_;           /*!<Overwritten records*/
+    static size_t last_check_;          /*!<Index of last check record. size when none*/
+
+
+    /*!
+     * @brief Reserve next record without locking
+     *
+     * @param time Time of record
+     * @return record_t& Record
+     */
+    static record_t& append( const uint64_t time );
+
+};
+
+
+#ifdef USE_TRACE
+    #define TRACE_RECORD(...) LinkTrace::record( __VA_ARGS__ )
+    #define TRACE_CHECK( link_status ) LinkTrace::recordCheck( link_status )
+#else
+    #define TRACE_RECORD(...) do {} while (0)
+    #define TRACE_CHECK( link_status ) do {} while (0)
+#endif
+
+#endif
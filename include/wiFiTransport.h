@@ -0,0 +1,401 @@
+#ifndef WIFITRANSPORT_H
+#define WIFITRANSPORT_H
+
+/*!
+ * @file wiFiTransport.h
+ * @author janwolzenburg
+ * @brief Class definitions of lwIP transport helpers
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include "pico/cyw43_arch.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "lwip/tcp.h"
+
+
+/*!
+ * @brief Scoped lwIP lock
+ * @details Takes cyw43_arch_lwip_begin() on construction and cyw43_arch_lwip_end() on destruction.
+ *          Required around lwIP calls outside of lwIP callbacks in background builds, no cost in polling builds.
+ *          The lock is recursive, so taking it again inside a callback or async worker is fine
+ */
+class LwipLock{
+
+    public:
+
+    LwipLock( void ){ cyw43_arch_lwip_begin(); };
+    ~LwipLock( void ){ cyw43_arch_lwip_end(); };
+
+    LwipLock( const LwipLock& lock ) = delete;
+    LwipLock& operator=( const LwipLock& lock ) = delete;
+
+};
+
+
+/*!
+ * @brief Send counters of a transport object
+ * @details Count what lwIP accepted, not what left the radio
+ */
+struct SendCounters{
+    uint32_t sends;                     /*!<Sends handed to lwIP*/
+    uint32_t failures;                  /*!<Sends lwIP refused. Never more than sends*/
+    uint32_t flush_failures;            /*!<Flushes of queued data lwIP refused*/
+};
+
+
+/*!
+ * @brief UDP endpoint sending from application buffers without copy
+ * @details Received pbuf chains are passed to the handler unflattened. The handler owns the chain and must free it.
+ *          All public methods take the recursive lwIP lock and can be called from lwIP callbacks and async workers
+ */
+class UdpEndpoint{
+
+    public:
+
+    /*!
+     * @brief Handler for received datagrams
+     * @details Called in lwIP context. Must call pbuf_free() on chain when done
+     *
+     */
+    typedef void (*receive_handler_t)( void* user_data, struct pbuf* chain, const ip_addr_t* address, uint16_t port );
+
+    /*!
+     * @brief Constructor
+     *
+     */
+    UdpEndpoint( void );
+
+    /*!
+     * @brief Destructor. Closes endpoint
+     *
+     */
+    ~UdpEndpoint( void );
+
+    /*!
+     * @brief No copy contructor
+     *
+     */
+    UdpEndpoint( const UdpEndpoint& endpoint ) = delete;
+
+    /*!
+     * @brief Copy assignment deleted
+     *
+     */
+    UdpEndpoint& operator=( const UdpEndpoint& endpoint ) = delete;
+
+    /*!
+     * @brief Open endpoint
+     *
+     * @param local_port Port to bind to. 0 for any
+     * @return int 0 on success
+     */
+    int open( const uint16_t local_port = 0 );
+
+    /*!
+     * @brief Close endpoint
+     *
+     */
+    void close( void );
+
+    /*!
+     * @brief Set handler for received datagrams
+     *
+     * @param handler Handler. nullptr to discard received datagrams
+     * @param user_data Passed to handler
+     */
+    void setReceiveHandler( const receive_handler_t handler, void* user_data );
+
+    /*!
+     * @brief Send application buffer without copying it
+     * @details Buffer is only referenced during the call. lwIP copies it if the packet has to be queued
+     *
+     * @param data Payload
+     * @param length Payload length
+     * @param address Destination address
+     * @param port Destination port
+     * @return int 0 on success, lwIP error code otherwise
+     */
+    int sendTo( const void* data, const uint16_t length, const ip_addr_t& address, const uint16_t port );
+
+    /*!
+     * @brief Send constant data without copying it
+     * @details Data must never change, e.g. in flash. lwIP will not copy it even when queued
+     *
+     * @param data Constant payload
+     * @param length Payload length
+     * @param address Destination address
+     * @param port Destination port
+     * @return int 0 on success, lwIP error code otherwise
+     */
+    int sendConstant( const void* data, const uint16_t length, const ip_addr_t& address, const uint16_t port );
+
+    /*!
+     * @brief Send pbuf chain from allocate()
+     * @details Chain is not freed. ARP may keep a reference to it while the address resolves,
+     *          so leave the chain untouched until it is freed and allocate a new one for the next datagram
+     *
+     * @param chain Payload
+     * @param address Destination address
+     * @param port Destination port
+     * @return int 0 on success, lwIP error code otherwise
+     */
+    int sendTo( struct pbuf* chain, const ip_addr_t& address, const uint16_t port );
+
+    /*!
+     * @brief Allocate pbuf chain from lwIP's fixed pool with room for headers
+     * @details Write payload in place, e.g. with pbuf_take(). No heap allocation involved
+     *
+     * @param length Payload length
+     * @return struct pbuf* Chain or nullptr when pool is empty
+     */
+    static struct pbuf* allocate( const uint16_t length );
+
+    /*!
+     * @brief Free chain from allocate() or a receive handler
+     *
+     * @param chain Chain to free
+     */
+    static void release( struct pbuf* chain );
+
+    /*!
+     * @brief Get whether endpoint is open
+     *
+     * @return true When open
+     * @return false Otherwise
+     */
+    bool isOpen( void ) const{ return pcb_ != nullptr; };
+
+    /*!
+     * @brief Get send counters
+     * @details A datagram counts as failed when no pbuf was available or udp_sendto() returned an error
+     *
+     * @return const SendCounters& Counters
+     */
+    const SendCounters& sendCounters( void ) const{ return send_counters_; };
+
+
+    private:
+
+    struct udp_pcb* pcb_;               /*!<lwIP UDP control block*/
+    receive_handler_t receive_handler_; /*!<Handler for received datagrams*/
+    void* user_data_;                   /*!<User data for handler*/
+    SendCounters send_counters_;        /*!<Send counters*/
+
+
+    /*!
+     * @brief Send pbuf referencing data
+     *
+     * @param data Payload
+     * @param length Payload length
+     * @param type PBUF_REF or PBUF_ROM
+     * @param address Destination address
+     * @param port Destination port
+     * @return int 0 on success, lwIP error code otherwise
+     */
+    int sendReference( const void* data, const uint16_t length, const pbuf_type type, const ip_addr_t& address, const uint16_t port );
+
+    /*!
+     * @brief lwIP receive callback
+     *
+     */
+    static void received( void* argument, struct udp_pcb* pcb, struct pbuf* chain, const ip_addr_t* address, uint16_t port );
+
+};
+
+
+/*!
+ * @brief TCP client connection writing application buffers without copy
+ * @details Written buffers are referenced until the peer acknowledges them. The sent handler reports acknowledged bytes
+ *          so buffers can be reused. Received pbuf chains are passed to the handler unflattened.
+ *          All public methods take the recursive lwIP lock. Calling them from lwIP callbacks or async workers is safe
+ */
+class TcpConnection{
+
+    public:
+
+    /*!
+     * @brief Handler for received data
+     * @details Called in lwIP context. Must call pbuf_free() on chain when done. Receive window is updated before the call
+     *
+     */
+    typedef void (*receive_handler_t)( void* user_data, struct pbuf* chain );
+
+    /*!
+     * @brief Handler for acknowledged data
+     * @details Called in lwIP context
+     *
+     */
+    typedef void (*sent_handler_t)( void* user_data, uint16_t acknowledged );
+
+    /*!
+     * @brief Handler for connection state changes
+     * @details Called in lwIP context with connected true on establishment and false on close, reset or abort
+     *
+     */
+    typedef void (*state_handler_t)( void* user_data, bool connected, err_t error );
+
+    /*!
+     * @brief Constructor
+     *
+     */
+    TcpConnection( void );
+
+    /*!
+     * @brief Destructor. Aborts connection
+     *
+     */
+    ~TcpConnection( void );
+
+    /*!
+     * @brief No copy contructor
+     *
+     */
+    TcpConnection( const TcpConnection& connection ) = delete;
+
+    /*!
+     * @brief Copy assignment deleted
+     *
+     */
+    TcpConnection& operator=( const TcpConnection& connection ) = delete;
+
+    /*!
+     * @brief Set handlers
+     *
+     * @param receive_handler Handler for received data. nullptr to discard
+     * @param sent_handler Handler for acknowledged data. May be nullptr
+     * @param state_handler Handler for state changes. May be nullptr
+     * @param user_data Passed to handlers
+     */
+    void setHandlers( const receive_handler_t receive_handler, const sent_handler_t sent_handler,
+                      const state_handler_t state_handler, void* user_data );
+
+    /*!
+     * @brief Start connecting
+     * @details Does return directly. State handler is called when connected
+     *
+     * @param address Server address
+     * @param port Server port
+     * @return int 0 on successful start, lwIP error code otherwise
+     */
+    int connect( const ip_addr_t& address, const uint16_t port );
+
+    /*!
+     * @brief Queue application buffer without copying it
+     * @details Buffer must stay unchanged until acknowledged
+     *
+     * @param data Payload
+     * @param length Payload length
+     * @param more More data follows. Delays sending
+     * @return int 0 on success, lwIP error code otherwise
+     */
+    int write( const void* data, const uint16_t length, const bool more = false );
+
+    /*!
+     * @brief Queue copy of data
+     *
+     * @param data Payload
+     * @param length Payload length
+     * @param more More data follows. Delays sending
+     * @return int 0 on success, lwIP error code otherwise
+     */
+    int writeCopy( const void* data, const uint16_t length, const bool more = false );
+
+    /*!
+     * @brief Send queued data now
+     *
+     * @return int 0 on success, lwIP error code otherwise
+     */
+    int flush( void );
+
+    /*!
+     * @brief Get free space in send buffer
+     *
+     * @return uint16_t Bytes that can be written
+     */
+    uint16_t sendBufferSpace( void ) const;
+
+    /*!
+     * @brief Close connection gracefully. Aborts when close fails
+     *
+     */
+    void close( void );
+
+    /*!
+     * @brief Abort connection with reset
+     *
+     */
+    void abort( void );
+
+    /*!
+     * @brief Get whether connection is established
+     *
+     * @return true When established
+     * @return false Otherwise
+     */
+    bool connected( void ) const{ return connected_; };
+
+    /*!
+     * @brief Get whether connection is established or being established
+     *
+     * @return true When a control block exists
+     * @return false Otherwise
+     */
+    bool isOpen( void ) const{ return pcb_ != nullptr; };
+
+    /*!
+     * @brief Get send counters
+     * @details Every write() and writeCopy() on an established connection counts as a send. Writes refused by tcp_write()
+     *          count as failures, flushes refused by tcp_output() as flush failures. Segments lwIP accepted may still be lost on air
+     *
+     * @return const SendCounters& Counters
+     */
+    const SendCounters& sendCounters( void ) const{ return send_counters_; };
+
+
+    private:
+
+    struct tcp_pcb* pcb_;               /*!<lwIP TCP control block*/
+    bool connected_;                    /*!<Connection established*/
+    bool aborted_;                      /*!<abort() was called. Tells receive callback to return ERR_ABRT*/
+    receive_handler_t receive_handler_; /*!<Handler for received data*/
+    sent_handler_t sent_handler_;       /*!<Handler for acknowledged data*/
+    state_handler_t state_handler_;     /*!<Handler for state changes*/
+    void* user_data_;                   /*!<User data for handlers*/
+    SendCounters send_counters_;        /*!<Send counters*/
+
+
+    /*!
+     * @brief Queue data
+     *
+     * @param data Payload
+     * @param length Payload length
+     * @param flags lwIP write flags
+     * @return int 0 on success, lwIP error code otherwise
+     */
+    int enqueue( const void* data, const uint16_t length, const uint8_t flags );
+
+    /*!
+     * @brief Detach callbacks and forget pcb without locking
+     *
+     */
+    void detach( void );
+
+    /*!
+     * @brief Notify state handler
+     *
+     * @param connected Connection established
+     * @param error lwIP error code
+     */
+    void notifyState( const bool connected, const err_t error );
+
+    static err_t connectedCallback( void* argument, struct tcp_pcb* pcb, err_t error );
+    static err_t receivedCallback( void* argument, struct tcp_pcb* pcb, struct pbuf* chain, err_t error );
+    static err_t sentCallback( void* argument, struct tcp_pcb* pcb, uint16_t length );
+    static void errorCallback( void* argument, err_t error );
+
+};
+
+#endif
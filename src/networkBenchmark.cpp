@@ -0,0 +1,793 @@
+/*!
+ * @file networkBenchmark.cpp
+ * @author janwolzenburg
+ * @brief Implementation of NetworkBenchmark class
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "networkBenchmark.h"
+
+// lwIP calls from outside of callbacks must hold the lock in background builds
+#if LIB_PICO_CYW43_ARCH
+    #include "pico/cyw43_arch.h"
+    #define LWIP_LOCK_BEGIN() cyw43_arch_lwip_begin()
+    #define LWIP_LOCK_END() cyw43_arch_lwip_end()
+#else
+    #define LWIP_LOCK_BEGIN() do {} while (0)
+    #define LWIP_LOCK_END() do {} while (0)
+#endif
+
+
+uint8_t NetworkBenchmark::payload_[max_payload_size] = {0};
+
+
+NetworkBenchmark::NetworkBenchmark( const clock_us_t clock ) :
+    clock_( clock ),
+    configuration_{},
+    result_{},
+    running_( false ),
+    start_time_( 0 ),
+    client_tcp_( nullptr ),
+    client_udp_( nullptr ),
+    client_connected_( false ),
+    sequence_( 0 ),
+    request_time_( 0 ),
+    request_pending_( false ),
+    response_bytes_( 0 ),
+    request_{ 0 },
+    latencies_( 0 ),
+    server_sink_( nullptr ),
+    server_echo_( nullptr ),
+    server_udp_( nullptr ),
+    server_connections_{},
+    server_bytes_( 0 ),
+    server_packets_( 0 )
+{
+    // Recognisable pattern. First byte marks datagrams as "discard"
+    for( size_t i = 0; i < max_payload_size; i++ ){
+        payload_[i] = static_cast<uint8_t>( 'a' + i % 26 );
+    }
+    payload_[0] = marker_sink;
+}
+
+
+NetworkBenchmark::~NetworkBenchmark( void ){
+    stop();
+    stopServer();
+}
+
+
+int NetworkBenchmark::startServer( const uint16_t port ){
+
+    stopServer();
+
+    LWIP_LOCK_BEGIN();
+
+    struct tcp_pcb* sink = tcp_new();
+    struct tcp_pcb* echo = tcp_new();
+    server_udp_ = udp_new();
+
+    if( sink == nullptr || echo == nullptr || server_udp_ == nullptr ){
+        if( sink != nullptr ) tcp_close( sink );
+        if( echo != nullptr ) tcp_close( echo );
+        LWIP_LOCK_END();
+        stopServer();
+        printf( "Benchmark server: out of memory\r\n" );
+        return -1;
+    }
+
+    if( tcp_bind( sink, IP_ADDR_ANY, port ) != ERR_OK ||
+        tcp_bind( echo, IP_ADDR_ANY, port + 1 ) != ERR_OK ||
+        udp_bind( server_udp_, IP_ADDR_ANY, port ) != ERR_OK ){
+
+        tcp_close( sink );
+        tcp_close( echo );
+        LWIP_LOCK_END();
+        stopServer();
+        printf( "Benchmark server: could not bind port %u\r\n", port );
+        return -1;
+    }
+
+    // tcp_listen() frees the bound pcb and returns a smaller listening pcb. On failure the bound pcb is kept
+    server_sink_ = tcp_listen( sink );
+    if( server_sink_ == nullptr ){
+        tcp_close( sink );
+        tcp_close( echo );
+        LWIP_LOCK_END();
+        stopServer();
+        printf( "Benchmark server: out of memory\r\n" );
+        return -1;
+    }
+
+    server_echo_ = tcp_listen( echo );
+    if( server_echo_ == nullptr ){
+        tcp_close( echo );
+        LWIP_LOCK_END();
+        stopServer();
+        printf( "Benchmark server: out of memory\r\n" );
+        return -1;
+    }
+
+    tcp_arg( server_sink_, this );
+    tcp_accept( server_sink_, serverSinkAccepted );
+    tcp_arg( server_echo_, this );
+    tcp_accept( server_echo_, serverEchoAccepted );
+    udp_recv( server_udp_, serverUdpReceived, this );
+
+    LWIP_LOCK_END();
+
+    server_bytes_ = 0;
+    server_packets_ = 0;
+
+    return 0;
+}
+
+
+void NetworkBenchmark::stopServer( void ){
+
+    LWIP_LOCK_BEGIN();
+
+    if( server_sink_ != nullptr ){
+        tcp_close( server_sink_ );
+        server_sink_ = nullptr;
+    }
+
+    if( server_echo_ != nullptr ){
+        tcp_close( server_echo_ );
+        server_echo_ = nullptr;
+    }
+
+    if( server_udp_ != nullptr ){
+        udp_remove( server_udp_ );
+        server_udp_ = nullptr;
+    }
+
+    // Clients still connected must not call back into a stopped or destroyed benchmark
+    for( server_connection_t& connection : server_connections_ ){
+        closeConnection( &connection );
+    }
+
+    LWIP_LOCK_END();
+}
+
+
+int NetworkBenchmark::start( const Configuration& configuration ){
+
+    if( running_ ){
+        printf( "Benchmark already running!\r\n" );
+        return -1;
+    }
+
+    if( configuration.payload_size < header_size || configuration.payload_size > max_payload_size ){
+        printf( "Benchmark payload size must be between %u and %u!\r\n", header_size, max_payload_size );
+        return -1;
+    }
+
+    configuration_ = configuration;
+    result_ = Result{};
+    result_.mode = configuration_.mode;
+
+    client_connected_ = false;
+    request_pending_ = false;
+    response_bytes_ = 0;
+    sequence_ = 0;
+
+    // Reserve before measurement so no allocation happens while timing
+    latencies_.clear();
+    latencies_.reserve( configuration_.max_samples );
+
+    LWIP_LOCK_BEGIN();
+
+    err_t error = ERR_OK;
+
+    switch( configuration_.mode ){
+
+        case Mode::tcp_throughput:
+        case Mode::tcp_latency:
+            client_tcp_ = tcp_new();
+            if( client_tcp_ == nullptr ){
+                error = ERR_MEM;
+                break;
+            }
+
+            tcp_arg( client_tcp_, this );
+            tcp_sent( client_tcp_, clientSent );
+            tcp_recv( client_tcp_, clientReceived );
+            tcp_err( client_tcp_, clientError );
+
+            // Latency requests are small and must not wait for more data
+            if( configuration_.mode == Mode::tcp_latency ){
+                tcp_nagle_disable( client_tcp_ );
+            }
+
+            error = tcp_connect( client_tcp_, &configuration_.server,
+                                 configuration_.mode == Mode::tcp_latency ? configuration_.port + 1 : configuration_.port,
+                                 clientConnected );
+        break;
+
+        case Mode::udp_throughput:
+        case Mode::udp_latency:
+            client_udp_ = udp_new();
+            if( client_udp_ == nullptr ){
+                error = ERR_MEM;
+                break;
+            }
+
+            udp_recv( client_udp_, clientUdpReceived, this );
+            error = udp_connect( client_udp_, &configuration_.server, configuration_.port );
+        break;
+    }
+
+    if( error != ERR_OK ){
+        closeClient();
+        LWIP_LOCK_END();
+        printf( "Benchmark could not start. Error %i\r\n", error );
+        return -1;
+    }
+
+    running_ = true;
+    start_time_ = clock_();
+
+    // UDP needs no handshake
+    if( configuration_.mode == Mode::udp_latency ){
+        if( sendRequest() != ERR_OK ) result_.errors++;
+    }
+
+    LWIP_LOCK_END();
+
+    return 0;
+}
+
+
+void NetworkBenchmark::stop( void ){
+
+    if( !running_ )
+        return;
+
+    result_.elapsed_us = clock_() - start_time_;
+    running_ = false;
+
+    LWIP_LOCK_BEGIN();
+    closeClient();
+    LWIP_LOCK_END();
+
+    computeResult();
+}
+
+
+void NetworkBenchmark::update( void ){
+
+    if( !running_ )
+        return;
+
+    const uint64_t now = clock_();
+
+    // Test duration passed
+    if( now - start_time_ >= static_cast<uint64_t>( configuration_.duration_ms ) * 1000 ){
+        result_.completed = true;
+        stop();
+        return;
+    }
+
+    // Connection aborted by lwIP or closed by server
+    if( ( configuration_.mode == Mode::tcp_throughput || configuration_.mode == Mode::tcp_latency ) && client_tcp_ == nullptr ){
+        stop();
+        return;
+    }
+
+    LWIP_LOCK_BEGIN();
+
+    switch( configuration_.mode ){
+
+        case Mode::tcp_throughput:
+            if( client_connected_ ) fillTcpSendBuffer();
+        break;
+
+        case Mode::udp_throughput:
+            // Send until lwIP runs out of buffers. Payload is referenced, not copied
+            while( true ){
+                struct pbuf* buffer = pbuf_alloc( PBUF_TRANSPORT, configuration_.payload_size, PBUF_REF );
+                if( buffer == nullptr ){
+                    break;
+                }
+
+                buffer->payload = payload_;
+                const err_t error = udp_send( client_udp_, buffer );
+                pbuf_free( buffer );
+
+                if( error != ERR_OK ){
+                    // Out of memory is back pressure, not a failure
+                    if( error != ERR_MEM ) result_.errors++;
+                    break;
+                }
+
+                result_.bytes += configuration_.payload_size;
+                result_.packets++;
+
+                // Give the driver the chance to drain
+                if( clock_() - now > 1000 ) break;
+            }
+        break;
+
+        case Mode::tcp_latency:
+        case Mode::udp_latency:
+            // Request lost
+            if( request_pending_ && now - request_time_ > static_cast<uint64_t>( configuration_.response_timeout_ms ) * 1000 ){
+                result_.errors++;
+                request_pending_ = false;
+
+                // A lost byte stream cannot be resynchronised
+                if( configuration_.mode == Mode::tcp_latency ){
+                    LWIP_LOCK_END();
+                    stop();
+                    return;
+                }
+            }
+
+            if( !request_pending_ && ( configuration_.mode == Mode::udp_latency || client_connected_ ) ){
+                if( sendRequest() != ERR_OK ) result_.errors++;
+            }
+        break;
+    }
+
+    LWIP_LOCK_END();
+}
+
+
+void NetworkBenchmark::printResult( const Result& result ){
+    printf( "benchmark mode=%s completed=%u elapsed_us=%llu bytes=%llu packets=%lu errors=%lu kbit_s=%lu pps=%lu "
+            "samples=%lu min_us=%lu p50_us=%lu p90_us=%lu p99_us=%lu max_us=%lu\r\n",
+            modeName( result.mode ), result.completed ? 1u : 0u,
+            static_cast<unsigned long long>( result.elapsed_us ), static_cast<unsigned long long>( result.bytes ),
+            static_cast<unsigned long>( result.packets ), static_cast<unsigned long>( result.errors ),
+            static_cast<unsigned long>( result.throughput_kbit_s ), static_cast<unsigned long>( result.packets_per_s ),
+            static_cast<unsigned long>( result.latency_samples ),
+            static_cast<unsigned long>( result.latency_min_us ), static_cast<unsigned long>( result.latency_p50_us ),
+            static_cast<unsigned long>( result.latency_p90_us ), static_cast<unsigned long>( result.latency_p99_us ),
+            static_cast<unsigned long>( result.latency_max_us ) );
+}
+
+
+const char* NetworkBenchmark::modeName( const Mode mode ){
+    switch( mode ){
+        case Mode::tcp_throughput: return "tcp_throughput";
+        case Mode::udp_throughput: return "udp_throughput";
+        case Mode::tcp_latency: return "tcp_latency";
+        case Mode::udp_latency: return "udp_latency";
+    }
+    return "unknown";
+}
+
+
+err_t NetworkBenchmark::closeClient( void ){
+
+    err_t result = ERR_OK;
+
+    if( client_tcp_ != nullptr ){
+        tcp_arg( client_tcp_, nullptr );
+        tcp_sent( client_tcp_, nullptr );
+        tcp_recv( client_tcp_, nullptr );
+        tcp_err( client_tcp_, nullptr );
+
+        if( tcp_close( client_tcp_ ) != ERR_OK ){
+            tcp_abort( client_tcp_ );
+            result = ERR_ABRT;
+        }
+        client_tcp_ = nullptr;
+    }
+
+    if( client_udp_ != nullptr ){
+        udp_remove( client_udp_ );
+        client_udp_ = nullptr;
+    }
+
+    client_connected_ = false;
+
+    return result;
+}
+
+
+void NetworkBenchmark::fillTcpSendBuffer( void ){
+
+    bool written = false;
+
+    // Payload is constant so lwIP may reference it without copy
+    while( tcp_sndbuf( client_tcp_ ) >= configuration_.payload_size && tcp_sndqueuelen( client_tcp_ ) < TCP_SND_QUEUELEN ){
+        if( tcp_write( client_tcp_, payload_, configuration_.payload_size, TCP_WRITE_FLAG_MORE ) != ERR_OK ){
+            break;
+        }
+        result_.packets++;
+        written = true;
+    }
+
+    if( written ){
+        tcp_output( client_tcp_ );
+    }
+}
+
+
+err_t NetworkBenchmark::sendRequest( void ){
+
+    sequence_++;
+    request_[0] = marker_echo;
+    memcpy( &request_[1], &sequence_, sizeof( sequence_ ) );
+
+    response_bytes_ = 0;
+    request_pending_ = true;
+    request_time_ = clock_();
+
+    err_t error = ERR_OK;
+
+    if( configuration_.mode == Mode::tcp_latency ){
+        error = tcp_write( client_tcp_, request_, configuration_.payload_size, TCP_WRITE_FLAG_COPY );
+        if( error == ERR_OK ) error = tcp_output( client_tcp_ );
+    }
+    else{
+        struct pbuf* buffer = pbuf_alloc( PBUF_TRANSPORT, configuration_.payload_size, PBUF_REF );
+        if( buffer == nullptr ){
+            error = ERR_MEM;
+        }
+        else{
+            buffer->payload = request_;
+            error = udp_send( client_udp_, buffer );
+            pbuf_free( buffer );
+        }
+    }
+
+    if( error != ERR_OK ){
+        request_pending_ = false;
+    }
+
+    return error;
+}
+
+
+void NetworkBenchmark::receivedResponse( const uint16_t length ){
+
+    if( !request_pending_ )
+        return;
+
+    response_bytes_ += length;
+    if( response_bytes_ < configuration_.payload_size )
+        return;
+
+    const uint64_t round_trip = clock_() - request_time_;
+
+    request_pending_ = false;
+    result_.packets++;
+    result_.bytes += configuration_.payload_size;
+
+    if( latencies_.size() < configuration_.max_samples ){
+        latencies_.push_back( static_cast<uint32_t>( round_trip ) );
+    }
+
+    // Next request right away
+    if( running_ ){
+        if( sendRequest() != ERR_OK ) result_.errors++;
+    }
+}
+
+
+void NetworkBenchmark::computeResult( void ){
+
+    if( result_.elapsed_us > 0 ){
+        result_.throughput_kbit_s = static_cast<uint32_t>( result_.bytes * 8000 / result_.elapsed_us );
+        result_.packets_per_s = static_cast<uint32_t>( static_cast<uint64_t>( result_.packets ) * 1000000 / result_.elapsed_us );
+    }
+
+    result_.latency_samples = static_cast<uint32_t>( latencies_.size() );
+    if( latencies_.empty() )
+        return;
+
+    std::sort( latencies_.begin(), latencies_.end() );
+
+    // Nearest rank
+    const auto percentile = [&]( const size_t percent ){
+        size_t rank = ( percent * latencies_.size() + 99 ) / 100;
+        return latencies_.at( rank > 0 ? rank - 1 : 0 );
+    };
+
+    result_.latency_min_us = latencies_.front();
+    result_.latency_p50_us = percentile( 50 );
+    result_.latency_p90_us = percentile( 90 );
+    result_.latency_p99_us = percentile( 99 );
+    result_.latency_max_us = latencies_.back();
+}
+
+
+err_t NetworkBenchmark::clientConnected( void* argument, struct tcp_pcb* pcb, err_t error ){
+    NetworkBenchmark* benchmark = static_cast<NetworkBenchmark*>( argument );
+    if( benchmark == nullptr || error != ERR_OK ) return ERR_OK;
+
+    benchmark->client_connected_ = true;
+
+    // Throughput is measured from the first byte on
+    benchmark->start_time_ = benchmark->clock_();
+
+    if( benchmark->configuration_.mode == Mode::tcp_throughput ){
+        benchmark->fillTcpSendBuffer();
+    }
+    else{
+        if( benchmark->sendRequest() != ERR_OK ) benchmark->result_.errors++;
+    }
+
+    return ERR_OK;
+}
+
+
+err_t NetworkBenchmark::clientSent( void* argument, struct tcp_pcb* pcb, uint16_t length ){
+    NetworkBenchmark* benchmark = static_cast<NetworkBenchmark*>( argument );
+    if( benchmark == nullptr || !benchmark->running_ ) return ERR_OK;
+
+    if( benchmark->configuration_.mode == Mode::tcp_throughput ){
+        benchmark->result_.bytes += length;
+        benchmark->fillTcpSendBuffer();
+    }
+
+    return ERR_OK;
+}
+
+
+err_t NetworkBenchmark::clientReceived( void* argument, struct tcp_pcb* pcb, struct pbuf* buffer, err_t error ){
+    NetworkBenchmark* benchmark = static_cast<NetworkBenchmark*>( argument );
+
+    // Remote closed. A benchmark server never closes first, so the test ends with an error
+    if( buffer == nullptr ){
+        if( benchmark == nullptr ) return ERR_OK;
+
+        benchmark->result_.errors++;
+        printf( "Benchmark connection closed by server\r\n" );
+
+        // update() stops the test once the connection is gone
+        return benchmark->closeClient();
+    }
+
+    const uint16_t length = buffer->tot_len;
+    tcp_recved( pcb, length );
+    pbuf_free( buffer );
+
+    if( benchmark != nullptr ) benchmark->receivedResponse( length );
+
+    return ERR_OK;
+}
+
+
+void NetworkBenchmark::clientError( void* argument, err_t error ){
+    NetworkBenchmark* benchmark = static_cast<NetworkBenchmark*>( argument );
+    if( benchmark == nullptr ) return;
+
+    // pcb is already freed by lwIP
+    benchmark->client_tcp_ = nullptr;
+    benchmark->client_connected_ = false;
+    benchmark->result_.errors++;
+    printf( "Benchmark connection error %i\r\n", error );
+}
+
+
+void NetworkBenchmark::clientUdpReceived( void* argument, struct udp_pcb* pcb, struct pbuf* buffer, const ip_addr_t* address, uint16_t port ){
+    NetworkBenchmark* benchmark = static_cast<NetworkBenchmark*>( argument );
+
+    uint32_t sequence = 0;
+    const bool complete = buffer->tot_len >= header_size &&
+                          pbuf_copy_partial( buffer, &sequence, sizeof( sequence ), 1 ) == sizeof( sequence );
+    const uint16_t length = buffer->tot_len;
+    pbuf_free( buffer );
+
+    // Ignore late responses to lost requests
+    if( benchmark != nullptr && complete && sequence == benchmark->sequence_ ){
+        benchmark->receivedResponse( length );
+    }
+}
+
+
+err_t NetworkBenchmark::acceptConnection( struct tcp_pcb* pcb, tcp_recv_fn received ){
+
+    for( server_connection_t& connection : server_connections_ ){
+        if( connection.pcb != nullptr )
+            continue;
+
+        connection.benchmark = this;
+        connection.pcb = pcb;
+        connection.pending = nullptr;
+        connection.echoed = 0;
+
+        tcp_arg( pcb, &connection );
+        tcp_recv( pcb, received );
+        tcp_err( pcb, serverError );
+        return ERR_OK;
+    }
+
+    tcp_abort( pcb );
+    return ERR_ABRT;
+}
+
+
+err_t NetworkBenchmark::closeConnection( server_connection_t* const connection ){
+
+    struct tcp_pcb* const pcb = connection->pcb;
+    if( pcb == nullptr )
+        return ERR_OK;
+
+    connection->pcb = nullptr;
+    if( connection->pending != nullptr ){
+        pbuf_free( connection->pending );
+        connection->pending = nullptr;
+    }
+
+    tcp_arg( pcb, nullptr );
+    tcp_recv( pcb, nullptr );
+    tcp_sent( pcb, nullptr );
+    tcp_err( pcb, nullptr );
+
+    if( tcp_close( pcb ) != ERR_OK ){
+        tcp_abort( pcb );
+        return ERR_ABRT;
+    }
+
+    return ERR_OK;
+}
+
+
+err_t NetworkBenchmark::serverSinkAccepted( void* argument, struct tcp_pcb* pcb, err_t error ){
+    NetworkBenchmark* benchmark = static_cast<NetworkBenchmark*>( argument );
+    if( benchmark == nullptr || error != ERR_OK || pcb == nullptr ) return ERR_VAL;
+
+    return benchmark->acceptConnection( pcb, serverSinkReceived );
+}
+
+
+err_t NetworkBenchmark::serverEchoAccepted( void* argument, struct tcp_pcb* pcb, err_t error ){
+    NetworkBenchmark* benchmark = static_cast<NetworkBenchmark*>( argument );
+    if( benchmark == nullptr || error != ERR_OK || pcb == nullptr ) return ERR_VAL;
+
+    const err_t result = benchmark->acceptConnection( pcb, serverEchoReceived );
+    if( result == ERR_OK ){
+        tcp_sent( pcb, serverEchoSent );
+        tcp_nagle_disable( pcb );
+    }
+
+    return result;
+}
+
+
+err_t NetworkBenchmark::serverSinkReceived( void* argument, struct tcp_pcb* pcb, struct pbuf* buffer, err_t error ){
+    server_connection_t* const connection = static_cast<server_connection_t*>( argument );
+
+    // Client closed
+    if( buffer == nullptr ){
+        return connection != nullptr ? closeConnection( connection ) : ERR_OK;
+    }
+
+    if( connection == nullptr ){
+        tcp_recved( pcb, buffer->tot_len );
+        pbuf_free( buffer );
+        return ERR_OK;
+    }
+
+    NetworkBenchmark* const benchmark = connection->benchmark;
+
+    benchmark->server_bytes_ += buffer->tot_len;
+    benchmark->server_packets_++;
+
+    tcp_recved( pcb, buffer->tot_len );
+    pbuf_free( buffer );
+
+    return ERR_OK;
+}
+
+
+err_t NetworkBenchmark::serverEchoReceived( void* argument, struct tcp_pcb* pcb, struct pbuf* buffer, err_t error ){
+    server_connection_t* const connection = static_cast<server_connection_t*>( argument );
+
+    // Client closed
+    if( buffer == nullptr ){
+        return connection != nullptr ? closeConnection( connection ) : ERR_OK;
+    }
+
+    if( connection == nullptr ){
+        tcp_recved( pcb, buffer->tot_len );
+        pbuf_free( buffer );
+        return ERR_OK;
+    }
+
+    NetworkBenchmark* const benchmark = connection->benchmark;
+
+    benchmark->server_bytes_ += buffer->tot_len;
+    benchmark->server_packets_++;
+
+    // Data that does not fit into the send buffer now is echoed when acknowledgements make room
+    if( connection->pending == nullptr ){
+        connection->pending = buffer;
+    }
+    else{
+        pbuf_cat( connection->pending, buffer );
+    }
+
+    echoPending( connection );
+
+    return ERR_OK;
+}
+
+
+void NetworkBenchmark::echoPending( server_connection_t* const connection ){
+
+    struct tcp_pcb* const pcb = connection->pcb;
+    uint16_t written = 0;
+
+    while( connection->pending != nullptr ){
+        struct pbuf* const part = connection->pending;
+
+        uint16_t length = part->len - connection->echoed;
+        if( length > tcp_sndbuf( pcb ) ) length = tcp_sndbuf( pcb );
+
+        if( length == 0 || tcp_write( pcb, static_cast<const uint8_t*>( part->payload ) + connection->echoed, length, TCP_WRITE_FLAG_COPY ) != ERR_OK )
+            break;
+
+        connection->echoed += length;
+        written += length;
+
+        if( connection->echoed < part->len )
+            break;
+
+        // First part done. pbuf_dechain() drops the reference of the first part to the rest, so take one
+        if( part->next != nullptr ){
+            pbuf_ref( part->next );
+        }
+        connection->pending = pbuf_dechain( part );
+        connection->echoed = 0;
+        pbuf_free( part );
+    }
+
+    if( written > 0 ){
+        tcp_output( pcb );
+        tcp_recved( pcb, written );
+    }
+}
+
+
+err_t NetworkBenchmark::serverEchoSent( void* argument, struct tcp_pcb* pcb, uint16_t length ){
+    server_connection_t* const connection = static_cast<server_connection_t*>( argument );
+
+    if( connection != nullptr && connection->pending != nullptr ){
+        echoPending( connection );
+    }
+
+    return ERR_OK;
+}
+
+
+void NetworkBenchmark::serverError( void* argument, err_t error ){
+    server_connection_t* const connection = static_cast<server_connection_t*>( argument );
+
+    // pcb is already freed by lwIP
+    if( connection != nullptr ){
+        connection->pcb = nullptr;
+        if( connection->pending != nullptr ){
+            pbuf_free( connection->pending );
+            connection->pending = nullptr;
+        }
+    }
+}
+
+
+void NetworkBenchmark::serverUdpReceived( void* argument, struct udp_pcb* pcb, struct pbuf* buffer, const ip_addr_t* address, uint16_t port ){
+    NetworkBenchmark* benchmark = static_cast<NetworkBenchmark*>( argument );
+
+    benchmark->server_bytes_ += buffer->tot_len;
+    benchmark->server_packets_++;
+
+    uint8_t marker = 0;
+    pbuf_copy_partial( buffer, &marker, 1, 0 );
+
+    // Received pbuf can be sent back as is
+    if( marker == marker_echo ){
+        udp_sendto( pcb, buffer, address, port );
+    }
+
+    pbuf_free( buffer );
+}
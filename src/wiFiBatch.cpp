@@ -0,0 +1,235 @@
+/*!
+ * @file wiFiBatch.cpp
+ * @author janwolzenburg
+ * @brief Implementation of BatchSender class
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+#include "wiFiBatch.h"
+#include "wiFiStation.h"
+
+
+BatchSender::BatchSender( const uint32_t max_age_ms, const uint32_t power_save_max_age_ms, const uint16_t flush_threshold ) :
+    frame_{},
+    length_( 0 ),
+    messages_( 0 ),
+    first_added_( 0 ),
+    added_sum_( 0 ),
+    max_age_ms_( max_age_ms > 0 ? max_age_ms : 1 ),
+    power_save_max_age_ms_( power_save_max_age_ms > max_age_ms_ ? power_save_max_age_ms : max_age_ms_ ),
+    flush_threshold_( flush_threshold > 0 && flush_threshold < frame_size ? flush_threshold : frame_size ),
+    power_save_( false ),
+    connection_( nullptr ),
+    endpoint_( nullptr ),
+    address_{},
+    port_( 0 ),
+    statistics_{},
+    link_worker_{},
+    age_worker_{}
+{
+    link_worker_.do_work = linkWork;
+    link_worker_.user_data = this;
+    age_worker_.do_work = ageWork;
+    age_worker_.user_data = this;
+
+    WiFiStation::addLinkWorker( &link_worker_, linkChanged, this );
+
+    if( WiFiStation::connectionState() == WiFiStation::ConnectionState::connected ){
+        updatePowerSave();
+    }
+}
+
+
+BatchSender::~BatchSender( void ){
+    WiFiStation::removeLinkWorker( &link_worker_, linkChanged, this );
+
+    LwipLock lock;
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &age_worker_ );
+}
+
+
+void BatchSender::setDestination( TcpConnection* const connection ){
+    LwipLock lock;
+    connection_ = connection;
+    endpoint_ = nullptr;
+}
+
+
+void BatchSender::setDestination( UdpEndpoint* const endpoint, const ip_addr_t& address, const uint16_t port ){
+    LwipLock lock;
+    connection_ = nullptr;
+    endpoint_ = endpoint;
+    address_ = address;
+    port_ = port;
+}
+
+
+int BatchSender::add( const void* const data, const uint16_t length ){
+
+    if( data == nullptr || length == 0 || length > frame_size )
+        return -1;
+
+    LwipLock lock;
+
+    // Make room. Keep frame when it cannot be sent
+    if( length_ + length > frame_size && send( FlushReason::size ) != 0 ){
+        statistics_.rejected++;
+        return -1;
+    }
+
+    const uint64_t now = time_us_64();
+    if( messages_ == 0 ){
+        first_added_ = now;
+        added_sum_ = 0;
+        scheduleAge();
+    }
+
+    memcpy( &frame_[length_], data, length );
+    length_ += length;
+    messages_++;
+    added_sum_ += now - first_added_;
+
+    if( length_ >= flush_threshold_ ){
+        send( FlushReason::size );
+    }
+
+    return 0;
+}
+
+
+int BatchSender::flush( void ){
+    LwipLock lock;
+    return send( FlushReason::manual );
+}
+
+
+void BatchSender::updatePowerSave( void ){
+    uint32_t power_management = 0;
+
+    cyw43_arch_lwip_begin();
+    const int error = cyw43_wifi_get_pm( &cyw43_state, &power_management );
+    cyw43_arch_lwip_end();
+
+    // Lowest nibble is the power save mode. 0 keeps the radio awake
+    power_save_ = error == 0 && ( power_management & 0xf ) != 0;
+}
+
+
+uint32_t BatchSender::batchingFactorPercent( void ) const{
+    if( statistics_.frames == 0 )
+        return 0;
+
+    return static_cast<uint32_t>( static_cast<uint64_t>( statistics_.messages ) * 100 / statistics_.frames );
+}
+
+
+uint32_t BatchSender::meanLatencyUs( void ) const{
+    if( statistics_.messages == 0 )
+        return 0;
+
+    return static_cast<uint32_t>( statistics_.latency_sum_us / statistics_.messages );
+}
+
+
+void BatchSender::print( void ) const{
+    const uint32_t factor = batchingFactorPercent();
+
+    printf( "batch_messages=%u batch_frames=%u batch_bytes=%u batching_factor=%u.%02u mean_latency_us=%u max_latency_us=%u "
+            "flush_size=%u flush_age=%u flush_manual=%u flush_link_up=%u rejected=%u send_failures=%u power_save=%u\r\n",
+            static_cast<unsigned int>( statistics_.messages ), static_cast<unsigned int>( statistics_.frames ),
+            static_cast<unsigned int>( statistics_.bytes ),
+            static_cast<unsigned int>( factor / 100 ), static_cast<unsigned int>( factor % 100 ),
+            static_cast<unsigned int>( meanLatencyUs() ), static_cast<unsigned int>( statistics_.latency_max_us ),
+            static_cast<unsigned int>( statistics_.flushes[static_cast<size_t>( FlushReason::size )] ),
+            static_cast<unsigned int>( statistics_.flushes[static_cast<size_t>( FlushReason::age )] ),
+            static_cast<unsigned int>( statistics_.flushes[static_cast<size_t>( FlushReason::manual )] ),
+            static_cast<unsigned int>( statistics_.flushes[static_cast<size_t>( FlushReason::link_up )] ),
+            static_cast<unsigned int>( statistics_.rejected ), static_cast<unsigned int>( statistics_.send_failures ),
+            power_save_ ? 1u : 0u );
+}
+
+
+int BatchSender::send( const FlushReason reason ){
+
+    if( messages_ == 0 )
+        return 0;
+
+    int error = ERR_CONN;
+
+    if( connection_ != nullptr ){
+        if( connection_->sendBufferSpace() < length_ ){
+            error = ERR_MEM;
+        }
+        else if( ( error = connection_->writeCopy( frame_, length_ ) ) == 0 ){
+            connection_->flush();
+        }
+    }
+    else if( endpoint_ != nullptr ){
+        error = endpoint_->sendTo( frame_, length_, address_, port_ );
+    }
+
+    if( error != 0 ){
+        statistics_.send_failures++;
+        return error;
+    }
+
+    // Every message waited from its own add until now
+    const uint64_t now = time_us_64();
+    const uint64_t waited = static_cast<uint64_t>( messages_ ) * ( now - first_added_ ) - added_sum_;
+    const uint64_t oldest = now - first_added_;
+
+    statistics_.messages += messages_;
+    statistics_.frames++;
+    statistics_.bytes += length_;
+    statistics_.flushes[static_cast<size_t>( reason )]++;
+    statistics_.latency_sum_us += waited;
+    if( oldest > statistics_.latency_max_us ){
+        statistics_.latency_max_us = oldest > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>( oldest );
+    }
+
+    length_ = 0;
+    messages_ = 0;
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &age_worker_ );
+
+    return 0;
+}
+
+
+void BatchSender::scheduleAge( void ){
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &age_worker_ );
+    async_context_add_at_time_worker_in_ms( cyw43_arch_async_context(), &age_worker_, power_save_ ? power_save_max_age_ms_ : max_age_ms_ );
+}
+
+
+void BatchSender::linkChanged( void* user_data, const bool link_up ){
+    BatchSender* const sender = static_cast<BatchSender*>( user_data );
+
+    if( link_up ){
+        async_context_set_work_pending( cyw43_arch_async_context(), &sender->link_worker_ );
+    }
+}
+
+
+void BatchSender::linkWork( async_context_t* context, async_when_pending_worker_t* worker ){
+    BatchSender* const sender = static_cast<BatchSender*>( worker->user_data );
+
+    sender->updatePowerSave();
+
+    // Frame held back during the outage
+    sender->send( FlushReason::link_up );
+}
+
+
+void BatchSender::ageWork( async_context_t* context, async_at_time_worker_t* worker ){
+    BatchSender* const sender = static_cast<BatchSender*>( worker->user_data );
+
+    // Try again at the next deadline when the destination cannot take the frame
+    if( sender->send( FlushReason::age ) != 0 ){
+        sender->scheduleAge();
+    }
+}
@@ -0,0 +1,236 @@
+/*!
+ * @file wiFiChannelAnalytics.cpp
+ * @author janwolzenburg
+ * @brief Implementation of ChannelAnalytics class
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "wiFiChannelAnalytics.h"
+
+
+// Overlap of 2.4 GHz channels in 1/16 by channel distance. 20 MHz wide channels 5 MHz apart
+static constexpr uint8_t overlap[5] = { 16, 12, 8, 4, 1 };
+
+
+ChannelAnalytics::ChannelAnalytics( void ){
+    clear();
+}
+
+
+void ChannelAnalytics::beginScan( void ){
+    memset( scan_access_points_, 0, sizeof( scan_access_points_ ) );
+    memset( scan_power_, 0, sizeof( scan_power_ ) );
+    memset( scan_strongest_, INT8_MIN, sizeof( scan_strongest_ ) );
+    scan_bssid_count_ = 0;
+    memset( scan_bssid_filter_, 0, sizeof( scan_bssid_filter_ ) );
+    scan_filtered_count_ = 0;
+}
+
+
+void ChannelAnalytics::addResult( const cyw43_ev_scan_result_t& result ){
+
+    if( result.channel < 1 || result.channel > max_channel )
+        return;
+
+    // The driver reports access points once per received beacon or probe response
+    for( size_t i = 0; i < scan_bssid_count_; i++ ){
+        if( memcmp( scan_bssids_[i], result.bssid, sizeof( scan_bssids_[i] ) ) == 0 ){
+            return;
+        }
+    }
+
+    if( scan_bssid_count_ < max_unique_per_scan ){
+        memcpy( scan_bssids_[scan_bssid_count_++], result.bssid, sizeof( scan_bssids_[0] ) );
+    }
+    else{
+        // Dense environments. Cheaper than a larger table, rarely drops an access point
+        if( !addToFilter( result.bssid ) )
+            return;
+
+        if( scan_filtered_count_ < UINT16_MAX ) scan_filtered_count_++;
+    }
+
+    const uint8_t channel = static_cast<uint8_t>( result.channel );
+
+    // Power above noise floor in dB
+    int16_t power = result.rssi - rssi_bin_floor;
+    if( power < 0 ) power = 0;
+
+    scan_access_points_[channel]++;
+    scan_power_[channel] += power;
+
+    access_point_total_[channel]++;
+    rssi_sum_[channel] += result.rssi;
+
+    // Histogram
+    int16_t bin = ( result.rssi - rssi_bin_floor ) / rssi_bin_width + 1;
+    if( result.rssi < rssi_bin_floor ) bin = 0;
+    if( bin >= rssi_bins ) bin = rssi_bins - 1;
+
+    Channel& statistics = report_.channels[channel];
+    if( statistics.rssi_histogram[bin] < UINT16_MAX ) statistics.rssi_histogram[bin]++;
+    if( statistics.rssi_histogram[bin] >= UINT16_MAX / 2 ) histogram_full_ = true;
+
+    const int8_t rssi = result.rssi > INT8_MAX ? INT8_MAX : static_cast<int8_t>( result.rssi );
+    if( rssi > statistics.strongest_rssi ) statistics.strongest_rssi = rssi;
+    if( rssi > scan_strongest_[channel] ) scan_strongest_[channel] = rssi;
+}
+
+
+void ChannelAnalytics::endScan( void ){
+
+    // Halve history so sums cannot overflow and the averages keep following changes
+    if( report_.scans >= max_scans || histogram_full_ ){
+        report_.scans /= 2;
+        histogram_full_ = false;
+
+        for( uint8_t channel = 1; channel <= max_channel; channel++ ){
+            Channel& statistics = report_.channels[channel];
+
+            access_point_total_[channel] /= 2;
+            rssi_sum_[channel] /= 2;
+            interference_sum_[channel] /= 2;
+
+            for( uint8_t bin = 0; bin < rssi_bins; bin++ ){
+                statistics.rssi_histogram[bin] /= 2;
+            }
+
+            // Forget access points that are gone
+            statistics.strongest_rssi = scan_strongest_[channel];
+        }
+    }
+
+    report_.scans++;
+    report_.filtered_access_points = scan_filtered_count_;
+
+    uint32_t total = 0;
+
+    for( uint8_t channel = 1; channel <= max_channel; channel++ ){
+        Channel& statistics = report_.channels[channel];
+
+        interference_sum_[channel] += interferenceFromPower( scan_power_, channel );
+        total += access_point_total_[channel];
+
+        statistics.access_points = static_cast<uint16_t>( access_point_total_[channel] * 16 / report_.scans );
+        statistics.interference = static_cast<uint16_t>( interference_sum_[channel] / report_.scans );
+        statistics.mean_rssi = access_point_total_[channel] > 0 ?
+                               static_cast<int8_t>( rssi_sum_[channel] / static_cast<int32_t>( access_point_total_[channel] ) ) : INT8_MIN;
+    }
+
+    report_.access_points = static_cast<uint16_t>( total * 16 / report_.scans );
+
+    // Only the non overlapping channels are sensible choices
+    const uint8_t candidates[] = { 1, 6, 11 };
+    report_.least_interfered_channel = candidates[0];
+    for( const uint8_t channel : candidates ){
+        if( report_.channels[channel].interference < report_.channels[report_.least_interfered_channel].interference ){
+            report_.least_interfered_channel = channel;
+        }
+    }
+}
+
+
+void ChannelAnalytics::addScan( const vector<cyw43_ev_scan_result_t>& results ){
+    beginScan();
+    for( const auto& result : results ){
+        addResult( result );
+    }
+    endScan();
+}
+
+
+uint16_t ChannelAnalytics::interference( const uint8_t channel ) const{
+    if( channel < 1 || channel > max_channel )
+        return UINT16_MAX;
+
+    return report_.channels[channel].interference;
+}
+
+
+uint16_t ChannelAnalytics::currentInterference( const uint8_t channel ) const{
+    if( channel < 1 || channel > max_channel )
+        return UINT16_MAX;
+
+    return interferenceFromPower( scan_power_, channel );
+}
+
+
+void ChannelAnalytics::clear( void ){
+    memset( &report_, 0, sizeof( report_ ) );
+    for( uint8_t channel = 0; channel <= max_channel; channel++ ){
+        report_.channels[channel].strongest_rssi = INT8_MIN;
+        report_.channels[channel].mean_rssi = INT8_MIN;
+    }
+
+    memset( access_point_total_, 0, sizeof( access_point_total_ ) );
+    memset( rssi_sum_, 0, sizeof( rssi_sum_ ) );
+    memset( interference_sum_, 0, sizeof( interference_sum_ ) );
+    histogram_full_ = false;
+
+    beginScan();
+}
+
+
+void ChannelAnalytics::print( void ) const{
+
+    printf( "Channel analytics over %u scans. Least interfered channel: %u\r\n", report_.scans, report_.least_interfered_channel );
+    if( report_.filtered_access_points > 0 ){
+        printf( "%u access points in last scan deduplicated by hash\r\n", report_.filtered_access_points );
+    }
+    printf( "Ch.    APs Mean  Max  Interf.  <-90  -90  -80  -70  -60 >-50\r\n" );
+
+    for( uint8_t channel = 1; channel <= max_channel; channel++ ){
+        const Channel& statistics = report_.channels[channel];
+
+        printf( "%3u %3u.%02u %4d %4d %8u ", channel,
+                statistics.access_points / 16, ( statistics.access_points % 16 ) * 100 / 16,
+                statistics.mean_rssi, statistics.strongest_rssi, statistics.interference );
+
+        for( uint8_t bin = 0; bin < rssi_bins; bin++ ){
+            printf( " %4u", statistics.rssi_histogram[bin] );
+        }
+        printf( "\r\n" );
+    }
+}
+
+
+uint16_t ChannelAnalytics::interferenceFromPower( const uint16_t power[max_channel + 1], const uint8_t channel ){
+
+    uint32_t interference = 0;
+
+    for( int other = channel - 4; other <= channel + 4; other++ ){
+        if( other < 1 || other > max_channel ) continue;
+
+        const int distance = other > channel ? other - channel : channel - other;
+        interference += static_cast<uint32_t>( power[other] ) * overlap[distance];
+    }
+
+    interference /= 16;
+    return interference > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>( interference );
+}
+
+
+bool ChannelAnalytics::addToFilter( const uint8_t bssid[6] ){
+
+    // FNV-1a. Vendor prefix is shared by many access points, so hash all bytes
+    uint32_t hash = 2166136261u;
+    for( size_t i = 0; i < 6; i++ ){
+        hash = ( hash ^ bssid[i] ) * 16777619u;
+    }
+
+    const size_t first = hash % bssid_filter_bits;
+    const size_t second = ( hash >> 16 ) % bssid_filter_bits;
+
+    const bool known = ( scan_bssid_filter_[first / 8] & ( 1u << ( first % 8 ) ) ) &&
+                       ( scan_bssid_filter_[second / 8] & ( 1u << ( second % 8 ) ) );
+
+    scan_bssid_filter_[first / 8] |= static_cast<uint8_t>( 1u << ( first % 8 ) );
+    scan_bssid_filter_[second / 8] |= static_cast<uint8_t>( 1u << ( second % 8 ) );
+
+    return !known;
+}
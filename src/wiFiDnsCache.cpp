@@ -0,0 +1,291 @@
+/*!
+ * @file wiFiDnsCache.cpp
+ * @author janwolzenburg
+ * @brief Implementation of DnsCache class
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <string.h>
+#include <strings.h>
+#include "pico/time.h"
+#include "wiFiDnsCache.h"
+#include "wiFiStation.h"
+#include "wiFiTransport.h"
+
+
+DnsCache* DnsCache::registry_[max_caches] = {};
+
+
+DnsCache::DnsCache( const uint32_t refresh_interval_ms ) :
+    entries_{},
+    refresh_interval_us_( static_cast<uint64_t>( refresh_interval_ms ) * 1000 ),
+    prefetch_worker_{},
+    hits_( 0 ),
+    stale_hits_( 0 ),
+    misses_( 0 ),
+    registration_( nullptr )
+{
+    prefetch_worker_.do_work = prefetchWork;
+    prefetch_worker_.user_data = this;
+
+    cyw43_arch_lwip_begin();
+    for( DnsCache*& slot : registry_ ){
+        if( slot == nullptr ){
+            slot = this;
+            registration_ = &slot;
+            break;
+        }
+    }
+    cyw43_arch_lwip_end();
+
+    // The worker defers the prefetch
+    WiFiStation::addLinkWorker( &prefetch_worker_, linkChanged, this );
+}
+
+
+DnsCache::~DnsCache( void ){
+    WiFiStation::removeLinkWorker( &prefetch_worker_, linkChanged, this );
+
+    LwipLock lock;
+
+    // Queries in flight keep pointing to the slot
+    if( registration_ != nullptr ){
+        *registration_ = nullptr;
+    }
+}
+
+
+int DnsCache::addPrefetch( const char* const hostname ){
+
+    if( hostname == nullptr || strlen( hostname ) > max_hostname_length )
+        return -1;
+
+    LwipLock lock;
+
+    entry_t* const entry = findOrAllocate( hostname );
+    if( entry == nullptr )
+        return -1;
+
+    entry->prefetch = true;
+
+    // Resolve right away when connected
+    if( cyw43_tcpip_link_status( &cyw43_state, CYW43_ITF_STA ) == CYW43_LINK_UP && !entry->valid ){
+        refresh( *entry );
+    }
+
+    return 0;
+}
+
+
+int DnsCache::resolve( const char* const hostname, ip_addr_t& address, const resolved_callback_t callback, void* const user_data ){
+
+    if( hostname == nullptr || strlen( hostname ) > max_hostname_length )
+        return -1;
+
+    LwipLock lock;
+
+    entry_t* const entry = findOrAllocate( hostname );
+    if( entry == nullptr )
+        return -1;
+
+    const uint64_t now = time_us_64();
+    entry->last_used = now;
+
+    if( entry->valid ){
+        address = entry->address;
+
+        // Serve stale entry while refreshing
+        if( now - entry->resolved_at >= refresh_interval_us_ ){
+            stale_hits_++;
+            refresh( *entry );
+        }
+        else{
+            hits_++;
+        }
+
+        return 0;
+    }
+
+    misses_++;
+
+    refresh( *entry );
+
+    // Resolver answered from its own table
+    if( entry->valid ){
+        address = entry->address;
+        return 0;
+    }
+
+    if( !entry->in_flight )
+        return -1;
+
+    if( callback != nullptr ){
+        if( entry->waiter_count >= max_waiters )
+            return -1;
+
+        entry->waiters[entry->waiter_count++] = waiter_t{ callback, user_data };
+    }
+
+    return 1;
+}
+
+
+void DnsCache::prefetch( void ){
+    LwipLock lock;
+
+    const uint64_t now = time_us_64();
+
+    for( auto& entry : entries_ ){
+        if( entry.prefetch && ( !entry.valid || now - entry.resolved_at >= refresh_interval_us_ ) ){
+            refresh( entry );
+        }
+    }
+}
+
+
+void DnsCache::clear( void ){
+    LwipLock lock;
+
+    for( auto& entry : entries_ ){
+        // Pending lwIP queries still find the entry by name
+        if( entry.prefetch || entry.in_flight ){
+            entry.valid = false;
+            continue;
+        }
+        entry = entry_t{};
+    }
+}
+
+
+DnsCache::entry_t* DnsCache::find( const char* const hostname ){
+    for( auto& entry : entries_ ){
+        // DNS names are case insensitive
+        if( entry.hostname[0] != '\0' && strcasecmp( entry.hostname, hostname ) == 0 ){
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+
+DnsCache::entry_t* DnsCache::findOrAllocate( const char* const hostname ){
+
+    entry_t* entry = find( hostname );
+    if( entry != nullptr )
+        return entry;
+
+    // Free entry or least recently used entry that is not needed anymore
+    for( auto& candidate : entries_ ){
+        if( candidate.prefetch || candidate.in_flight ) continue;
+
+        if( candidate.hostname[0] == '\0' ){
+            entry = &candidate;
+            break;
+        }
+
+        if( entry == nullptr || candidate.last_used < entry->last_used ){
+            entry = &candidate;
+        }
+    }
+
+    if( entry == nullptr )
+        return nullptr;
+
+    *entry = entry_t{};
+    strncpy( entry->hostname, hostname, max_hostname_length );
+    entry->hostname[max_hostname_length] = '\0';
+
+    return entry;
+}
+
+
+void DnsCache::refresh( entry_t& entry ){
+
+    if( entry.in_flight )
+        return;
+
+    if( registration_ == nullptr ){
+        complete( entry, nullptr );
+        return;
+    }
+
+    ip_addr_t address;
+    const err_t error = dns_gethostbyname( entry.hostname, &address, found, registration_ );
+
+    switch( error ){
+        // Answered from lwIP's table. The record's TTL has not expired yet
+        case ERR_OK:
+            complete( entry, &address );
+        break;
+
+        // Query sent. Result arrives in found()
+        case ERR_INPROGRESS:
+            entry.in_flight = true;
+        break;
+
+        default:
+            complete( entry, nullptr );
+        break;
+    }
+}
+
+
+void DnsCache::complete( entry_t& entry, const ip_addr_t* const address ){
+
+    entry.in_flight = false;
+
+    if( address != nullptr ){
+        entry.address = *address;
+        entry.valid = true;
+        entry.resolved_at = time_us_64();
+    }
+
+    // Stale address is kept when refresh failed. Callers only wait when there was none.
+    // Copy waiters and result first. A callback may resolve again and reuse the entry
+    const size_t waiter_count = entry.waiter_count;
+    if( waiter_count == 0 )
+        return;
+
+    waiter_t waiters[max_waiters];
+    memcpy( waiters, entry.waiters, sizeof( waiters ) );
+    entry.waiter_count = 0;
+
+    char hostname[max_hostname_length + 1];
+    memcpy( hostname, entry.hostname, sizeof( hostname ) );
+    const bool valid = entry.valid;
+    const ip_addr_t resolved = entry.address;
+
+    for( size_t waiter = 0; waiter < waiter_count; waiter++ ){
+        waiters[waiter].callback( waiters[waiter].user_data, hostname, valid ? &resolved : nullptr );
+    }
+}
+
+
+void DnsCache::linkChanged( void* user_data, const bool link_up ){
+    DnsCache* const cache = static_cast<DnsCache*>( user_data );
+
+    if( link_up ){
+        async_context_set_work_pending( cyw43_arch_async_context(), &cache->prefetch_worker_ );
+    }
+}
+
+
+void DnsCache::prefetchWork( async_context_t* context, async_when_pending_worker_t* worker ){
+    static_cast<DnsCache*>( worker->user_data )->prefetch();
+}
+
+
+void DnsCache::found( const char* hostname, const ip_addr_t* address, void* argument ){
+    DnsCache* const cache = *static_cast<DnsCache**>( argument );
+
+    // Cache was destroyed while the query was in flight
+    if( cache == nullptr )
+        return;
+
+    entry_t* const entry = cache->find( hostname );
+    if( entry != nullptr ){
+        cache->complete( *entry, address );
+    }
+}
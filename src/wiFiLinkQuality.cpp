@@ -0,0 +1,272 @@
+/*!
+ * @file wiFiLinkQuality.cpp
+ * @author janwolzenburg
+ * @brief Implementation of LinkQuality
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+#include "wiFiLinkQuality.h"
+#include "wiFiStation.h"
+
+
+// Legacy wl_cnt_t returned by the "counters" iovar. Newer firmware returns a different layout with version 30 and above
+static constexpr uint16_t counters_max_version = 10;        /*!<Highest wl_cnt_t version with the legacy layout*/
+static constexpr size_t counters_txretrans = 3;             /*!<Word of txretrans behind version and length*/
+static constexpr size_t counters_txerror = 4;               /*!<Word of txerror behind version and length*/
+
+static uint32_t counters_buffer[256];                       /*!<Response of the iovar. Firmware refuses buffers shorter than wl_cnt_t*/
+
+
+LinkQuality::Sample LinkQuality::sample_ = {};
+int32_t LinkQuality::average_ = 0;
+int16_t LinkQuality::window_minimum_[2] = { INT16_MAX, INT16_MAX };
+int16_t LinkQuality::window_maximum_[2] = { INT16_MIN, INT16_MIN };
+uint32_t LinkQuality::window_samples_ = 0;
+uint32_t LinkQuality::window_ = 60;
+uint32_t LinkQuality::interval_ms_ = 1000;
+bool LinkQuality::running_ = false;
+bool LinkQuality::first_after_link_up_ = true;
+int16_t LinkQuality::alarm_threshold_ = INT16_MIN;
+LinkQuality::alarm_callback_t LinkQuality::alarm_callback_ = nullptr;
+void* LinkQuality::alarm_user_data_ = nullptr;
+const SendCounters* LinkQuality::sources_[max_sources] = {};
+async_at_time_worker_t LinkQuality::sample_worker_ = {};
+
+
+int LinkQuality::start( const uint32_t interval_ms, const uint32_t window ){
+
+    if( interval_ms == 0 || window == 0 )
+        return -1;
+
+    cyw43_arch_lwip_begin();
+
+    interval_ms_ = interval_ms;
+    window_ = window;
+    sample_worker_.do_work = sampleWork;
+
+    if( !running_ ){
+        running_ = true;
+        WiFiStation::addLinkCallback( linkChanged, nullptr );
+    }
+
+    // Already connected. No link up will follow
+    if( WiFiStation::connectionState() == WiFiStation::ConnectionState::connected ){
+        linkChanged( nullptr, true );
+    }
+
+    cyw43_arch_lwip_end();
+
+    return 0;
+}
+
+
+void LinkQuality::stop( void ){
+
+    cyw43_arch_lwip_begin();
+
+    if( running_ ){
+        running_ = false;
+        WiFiStation::removeLinkCallback( linkChanged, nullptr );
+        async_context_remove_at_time_worker( cyw43_arch_async_context(), &sample_worker_ );
+    }
+
+    cyw43_arch_lwip_end();
+}
+
+
+LinkQuality::Sample LinkQuality::sample( void ){
+    const uint32_t interrupts = save_and_disable_interrupts();
+
+    Sample current = sample_;
+    current.sends = 0;
+    current.send_failures = 0;
+    current.flush_failures = 0;
+
+    for( const SendCounters* const counters : sources_ ){
+        if( counters != nullptr ){
+            current.sends += counters->sends;
+            current.send_failures += counters->failures;
+            current.flush_failures += counters->flush_failures;
+        }
+    }
+
+    restore_interrupts( interrupts );
+
+    return current;
+}
+
+
+void LinkQuality::setAlarm( const int16_t threshold_dbm, const alarm_callback_t callback, void* const user_data ){
+    cyw43_arch_lwip_begin();
+
+    alarm_threshold_ = threshold_dbm;
+    alarm_callback_ = callback;
+    alarm_user_data_ = user_data;
+    sample_.degraded = false;
+
+    cyw43_arch_lwip_end();
+}
+
+
+void LinkQuality::print( void ){
+    const Sample current = sample();
+
+    printf( "rssi=%d rssi_average=%d rssi_min=%d rssi_max=%d rssi_samples=%u rssi_read_failures=%u "
+            "tx_retransmits=%u tx_errors=%u counter_read_failures=%u sends=%u send_failures=%u flush_failures=%u degraded=%u\r\n",
+            current.rssi, current.average, current.minimum, current.maximum,
+            static_cast<unsigned int>( current.samples ), static_cast<unsigned int>( current.read_failures ),
+            static_cast<unsigned int>( current.tx_retransmits ), static_cast<unsigned int>( current.tx_errors ),
+            static_cast<unsigned int>( current.counter_read_failures ),
+            static_cast<unsigned int>( current.sends ), static_cast<unsigned int>( current.send_failures ),
+            static_cast<unsigned int>( current.flush_failures ),
+            current.degraded ? 1u : 0u );
+}
+
+
+void LinkQuality::takeSample( void ){
+
+    readCounters();
+
+    int32_t rssi = 0;
+    if( cyw43_wifi_get_rssi( &cyw43_state, &rssi ) != 0 ){
+        sample_.read_failures++;
+        return;
+    }
+
+    const int16_t value = static_cast<int16_t>( rssi );
+
+    // Close window. Minimum and maximum span previous and current window
+    if( window_samples_ >= window_ ){
+        window_minimum_[0] = window_minimum_[1];
+        window_maximum_[0] = window_maximum_[1];
+        window_minimum_[1] = INT16_MAX;
+        window_maximum_[1] = INT16_MIN;
+        window_samples_ = 0;
+    }
+
+    if( value < window_minimum_[1] ) window_minimum_[1] = value;
+    if( value > window_maximum_[1] ) window_maximum_[1] = value;
+    window_samples_++;
+
+    if( first_after_link_up_ ){
+        average_ = value * average_scale;
+        first_after_link_up_ = false;
+    }
+    else{
+        average_ += ( value * average_scale - average_ ) / average_weight;
+    }
+
+    const int16_t average = static_cast<int16_t>( ( average_ + ( average_ >= 0 ? average_scale / 2 : -average_scale / 2 ) ) / average_scale );
+    const int16_t minimum = window_minimum_[0] < window_minimum_[1] ? window_minimum_[0] : window_minimum_[1];
+    const int16_t maximum = window_maximum_[0] > window_maximum_[1] ? window_maximum_[0] : window_maximum_[1];
+
+    // Hysteresis keeps a link at the threshold from toggling the alarm
+    const bool was_degraded = sample_.degraded;
+    const bool degraded = was_degraded ? average < alarm_threshold_ + alarm_hysteresis : average < alarm_threshold_;
+
+    const uint32_t interrupts = save_and_disable_interrupts();
+    sample_.rssi = value;
+    sample_.average = average;
+    sample_.minimum = minimum;
+    sample_.maximum = maximum;
+    sample_.samples++;
+    sample_.updated_us = time_us_64();
+    sample_.degraded = degraded;
+    restore_interrupts( interrupts );
+
+    if( degraded != was_degraded && alarm_callback_ != nullptr ){
+        alarm_callback_( alarm_user_data_, degraded, average );
+    }
+}
+
+
+void LinkQuality::readCounters( void ){
+
+    // Iovar name goes in, counters come back in the same buffer
+    memset( counters_buffer, 0, sizeof( counters_buffer ) );
+    memcpy( counters_buffer, "counters", sizeof( "counters" ) );
+
+    const int error = cyw43_ioctl( &cyw43_state, CYW43_IOCTL_GET_VAR, sizeof( counters_buffer ),
+                                   reinterpret_cast<uint8_t*>( counters_buffer ), CYW43_ITF_STA );
+
+    // Little endian version and length in the first word
+    const uint16_t version = static_cast<uint16_t>( counters_buffer[0] & 0xffff );
+    const uint16_t length = static_cast<uint16_t>( counters_buffer[0] >> 16 );
+
+    if( error != 0 || version == 0 || version > counters_max_version || length < ( counters_txerror + 1 ) * sizeof( uint32_t ) ){
+        sample_.counter_read_failures++;
+        return;
+    }
+
+    const uint32_t interrupts = save_and_disable_interrupts();
+    sample_.tx_retransmits = counters_buffer[counters_txretrans];
+    sample_.tx_errors = counters_buffer[counters_txerror];
+    restore_interrupts( interrupts );
+}
+
+
+int LinkQuality::addCounters( const SendCounters* const counters ){
+    const SendCounters** free_slot = nullptr;
+
+    cyw43_arch_lwip_begin();
+
+    // Counters added twice keep their slot
+    for( const SendCounters*& slot : sources_ ){
+        if( slot == counters ){
+            free_slot = &slot;
+            break;
+        }
+        if( slot == nullptr && free_slot == nullptr ){
+            free_slot = &slot;
+        }
+    }
+
+    if( free_slot != nullptr ){
+        *free_slot = counters;
+    }
+
+    cyw43_arch_lwip_end();
+
+    return free_slot != nullptr ? 0 : -1;
+}
+
+
+void LinkQuality::removeCounters( const SendCounters* const counters ){
+    cyw43_arch_lwip_begin();
+
+    for( const SendCounters*& slot : sources_ ){
+        if( slot == counters ){
+            slot = nullptr;
+        }
+    }
+
+    cyw43_arch_lwip_end();
+}
+
+
+void LinkQuality::linkChanged( void* user_data, const bool link_up ){
+
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &sample_worker_ );
+
+    if( link_up ){
+        first_after_link_up_ = true;
+        async_context_add_at_time_worker_in_ms( cyw43_arch_async_context(), &sample_worker_, 0 );
+    }
+}
+
+
+void LinkQuality::sampleWork( async_context_t* context, async_at_time_worker_t* worker ){
+    takeSample();
+
+    // Workers are removed before they run
+    if( running_ && WiFiStation::connectionState() == WiFiStation::ConnectionState::connected ){
+        async_context_add_at_time_worker_in_ms( context, worker, interval_ms_ );
+    }
+}
@@ -0,0 +1,87 @@
+/*!
+ * @file wiFiMemory.cpp
+ * @author janwolzenburg
+ * @brief Implementation of MemoryReport
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <malloc.h>
+#include "pico/cyw43_arch.h"
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+#include "wiFiMemory.h"
+#include "wiFiStation.h"
+
+
+MemoryReport::Usage MemoryReport::usage( void ){
+
+    Usage usage{};
+
+    usage.library_heap = WiFiStation::heapInUse();
+    usage.library_heap_peak = WiFiStation::heapPeak();
+    usage.scan_results = WiFiStation::scanResultCount();
+
+    const struct mallinfo heap = mallinfo();
+    usage.heap_used = static_cast<size_t>( heap.uordblks );
+    usage.heap_reserved = static_cast<size_t>( heap.arena );
+
+    cyw43_arch_lwip_begin();
+
+    #if LWIP_STATS && MEM_STATS
+    usage.lwip_heap_used = lwip_stats.mem.used;
+    usage.lwip_heap_peak = lwip_stats.mem.max;
+    usage.lwip_failures += lwip_stats.mem.err;
+    #endif
+
+    #if LWIP_STATS && MEMP_STATS
+    for( size_t pool = 0; pool < MEMP_MAX; pool++ ){
+        const struct stats_mem* const statistics = lwip_stats.memp[pool];
+        if( statistics == nullptr )
+            continue;
+
+        const size_t element_size = memp_pools[pool]->size;
+        usage.lwip_pool_used += statistics->used * element_size;
+        usage.lwip_pool_peak += statistics->max * element_size;
+        usage.lwip_pool_size += statistics->avail * element_size;
+        usage.lwip_failures += statistics->err;
+    }
+    #endif
+
+    cyw43_arch_lwip_end();
+
+    return usage;
+}
+
+
+void MemoryReport::print( void ){
+    const Usage current = usage();
+
+    printf( "library_heap=%u library_heap_peak=%u scan_results=%u heap_used=%u heap_reserved=%u "
+            "lwip_heap_used=%u lwip_heap_peak=%u lwip_pool_used=%u lwip_pool_peak=%u lwip_pool_size=%u lwip_failures=%u\r\n",
+            static_cast<unsigned int>( current.library_heap ), static_cast<unsigned int>( current.library_heap_peak ),
+            static_cast<unsigned int>( current.scan_results ),
+            static_cast<unsigned int>( current.heap_used ), static_cast<unsigned int>( current.heap_reserved ),
+            static_cast<unsigned int>( current.lwip_heap_used ), static_cast<unsigned int>( current.lwip_heap_peak ),
+            static_cast<unsigned int>( current.lwip_pool_used ), static_cast<unsigned int>( current.lwip_pool_peak ),
+            static_cast<unsigned int>( current.lwip_pool_size ), static_cast<unsigned int>( current.lwip_failures ) );
+
+    #if LWIP_STATS && MEMP_STATS && ( defined( LWIP_DEBUG ) || LWIP_STATS_DISPLAY )
+    cyw43_arch_lwip_begin();
+
+    for( size_t pool = 0; pool < MEMP_MAX; pool++ ){
+        const struct stats_mem* const statistics = lwip_stats.memp[pool];
+        if( statistics == nullptr )
+            continue;
+
+        printf( "pool=%s size=%u used=%u max=%u available=%u errors=%u\r\n",
+                statistics->name, static_cast<unsigned int>( memp_pools[pool]->size ),
+                static_cast<unsigned int>( statistics->used ), static_cast<unsigned int>( statistics->max ),
+                static_cast<unsigned int>( statistics->avail ), static_cast<unsigned int>( statistics->err ) );
+    }
+
+    cyw43_arch_lwip_end();
+    #endif
+}
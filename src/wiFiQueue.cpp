@@ -0,0 +1,350 @@
+/*!
+ * @file wiFiQueue.cpp
+ * @author janwolzenburg
+ * @brief Implementation of OutboundQueue class
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <string.h>
+#include "pico/time.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "wiFiQueue.h"
+#include "wiFiStation.h"
+
+
+static constexpr size_t header_size = 2;               /*!<Bytes of message length in front of each message*/
+
+
+OutboundQueue::OutboundQueue( uint8_t* const buffer, const size_t size, const uint32_t rate, const uint32_t burst ) :
+    buffer_( buffer ),
+    size_( buffer != nullptr ? size : 0 ),
+    head_( 0 ),
+    used_( 0 ),
+    flash_offset_( 0 ),
+    flash_size_( 0 ),
+    flash_head_( 0 ),
+    flash_used_( 0 ),
+    sink_( nullptr ),
+    sink_user_data_( nullptr ),
+    rate_( rate > 0 ? rate : 1 ),
+    burst_( static_cast<uint64_t>( burst > max_batch_size ? burst : max_batch_size ) * 1000000 ),
+    tokens_( burst_ ),
+    refilled_at_( time_us_64() ),
+    batch_{},
+    statistics_{},
+    drain_worker_{},
+    retry_worker_{}
+{
+    drain_worker_.do_work = drainWork;
+    drain_worker_.user_data = this;
+    retry_worker_.do_work = retryWork;
+    retry_worker_.user_data = this;
+
+    WiFiStation::addLinkWorker( &drain_worker_, linkChanged, this );
+}
+
+
+OutboundQueue::~OutboundQueue( void ){
+    WiFiStation::removeLinkWorker( &drain_worker_, linkChanged, this );
+
+    LwipLock lock;
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &retry_worker_ );
+}
+
+
+void OutboundQueue::setSink( const sink_t sink, void* const user_data ){
+    LwipLock lock;
+
+    sink_ = sink;
+    sink_user_data_ = user_data;
+
+    async_context_set_work_pending( cyw43_arch_async_context(), &drain_worker_ );
+}
+
+
+int OutboundQueue::setFlashOverflow( const uint32_t offset, const uint32_t size ){
+
+    if( offset % FLASH_SECTOR_SIZE != 0 || size % FLASH_SECTOR_SIZE != 0 || size == 0 ||
+        offset + size > PICO_FLASH_SIZE_BYTES || size_ < 2 * FLASH_PAGE_SIZE )
+        return -1;
+
+    LwipLock lock;
+
+    if( queued() > 0 )
+        return -1;
+
+    flash_offset_ = offset;
+    flash_size_ = size;
+    flash_head_ = 0;
+    flash_used_ = 0;
+
+    return 0;
+}
+
+
+int OutboundQueue::enqueue( const void* const data, const uint16_t length ){
+
+    if( data == nullptr || length == 0 || length > max_batch_size )
+        return -1;
+
+    const size_t needed = header_size + length;
+    const uint8_t header[header_size] = { static_cast<uint8_t>( length ), static_cast<uint8_t>( length >> 8 ) };
+
+    const uint32_t interrupts = save_and_disable_interrupts();
+
+    if( size_ - used_ < needed ){
+        statistics_.dropped++;
+        restore_interrupts( interrupts );
+        return -1;
+    }
+
+    // Copy header and message with wrap around
+    const uint8_t* const sources[2] = { header, static_cast<const uint8_t*>( data ) };
+    const size_t lengths[2] = { header_size, length };
+    size_t offset = ( head_ + used_ ) % size_;
+
+    for( size_t part = 0; part < 2; part++ ){
+        const size_t first = lengths[part] < size_ - offset ? lengths[part] : size_ - offset;
+
+        memcpy( &buffer_[offset], sources[part], first );
+        memcpy( &buffer_[0], sources[part] + first, lengths[part] - first );
+        offset = ( offset + lengths[part] ) % size_;
+    }
+
+    used_ = used_ + needed;
+    statistics_.enqueued++;
+    updatePeak();
+
+    const bool spill_needed = flash_size_ > 0 && used_ > size_ / 2;
+
+    restore_interrupts( interrupts );
+
+    if( spill_needed || WiFiStation::connectionState() == WiFiStation::ConnectionState::connected ){
+        async_context_set_work_pending( cyw43_arch_async_context(), &drain_worker_ );
+    }
+
+    return 0;
+}
+
+
+size_t OutboundQueue::queued( void ) const{
+    const uint32_t interrupts = save_and_disable_interrupts();
+    const size_t bytes = used_ + flash_used_;
+    restore_interrupts( interrupts );
+
+    return bytes;
+}
+
+
+int OutboundQueue::connectionSink( void* user_data, const uint8_t* data, uint16_t length ){
+    TcpConnection* const connection = static_cast<TcpConnection*>( user_data );
+
+    if( connection == nullptr || connection->sendBufferSpace() < length )
+        return -1;
+
+    if( connection->writeCopy( data, length ) != 0 )
+        return -1;
+
+    connection->flush();
+    return 0;
+}
+
+
+void OutboundQueue::service( void ){
+
+    const bool more_to_spill = spill();
+    uint32_t wait_ms = drain();
+
+    if( more_to_spill && ( wait_ms == 0 || wait_ms > 1 ) ){
+        wait_ms = 1;
+    }
+
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &retry_worker_ );
+    if( wait_ms > 0 ){
+        async_context_add_at_time_worker_in_ms( cyw43_arch_async_context(), &retry_worker_, wait_ms );
+    }
+}
+
+
+bool OutboundQueue::spill( void ){
+
+    if( flash_size_ == 0 )
+        return false;
+
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    for( size_t pages = 0; pages < max_spill_pages; pages++ ){
+
+        if( used_ <= size_ / 2 )
+            return false;
+
+        // Erasing a sector needs all of it to be read already
+        const uint32_t region_offset = static_cast<uint32_t>( ( flash_head_ + flash_used_ ) % flash_size_ );
+        const bool sector_start = region_offset % FLASH_SECTOR_SIZE == 0;
+        if( flash_used_ + ( sector_start ? FLASH_SECTOR_SIZE : FLASH_PAGE_SIZE ) > flash_size_ )
+            return false;
+
+        // Only the consumer moves head_, so the oldest page stays valid while it is programmed
+        const size_t offset = head_;
+        const size_t first = FLASH_PAGE_SIZE < size_ - offset ? FLASH_PAGE_SIZE : size_ - offset;
+        memcpy( page, &buffer_[offset], first );
+        memcpy( page + first, &buffer_[0], FLASH_PAGE_SIZE - first );
+
+        const uint32_t interrupts = save_and_disable_interrupts();
+
+        if( sector_start ){
+            flash_range_erase( flash_offset_ + region_offset, FLASH_SECTOR_SIZE );
+        }
+        flash_range_program( flash_offset_ + region_offset, page, FLASH_PAGE_SIZE );
+
+        flash_used_ = flash_used_ + FLASH_PAGE_SIZE;
+        head_ = ( head_ + FLASH_PAGE_SIZE ) % size_;
+        used_ = used_ - FLASH_PAGE_SIZE;
+
+        restore_interrupts( interrupts );
+
+        statistics_.spilled_pages++;
+    }
+
+    return used_ > size_ / 2;
+}
+
+
+uint32_t OutboundQueue::drain( void ){
+
+    if( sink_ == nullptr || WiFiStation::connectionState() != WiFiStation::ConnectionState::connected )
+        return 0;
+
+    const uint64_t now = time_us_64();
+    const uint64_t elapsed = now - refilled_at_;
+    refilled_at_ = now;
+
+    if( elapsed >= burst_ / rate_ ){
+        tokens_ = burst_;
+    }
+    else{
+        tokens_ += elapsed * rate_;
+        if( tokens_ > burst_ ) tokens_ = burst_;
+    }
+
+    while( true ){
+
+        const size_t total = queued();
+        if( total == 0 )
+            return 0;
+
+        // Whole messages up to one MSS
+        size_t position = 0;
+        uint16_t length = 0;
+        uint32_t messages = 0;
+
+        while( position < total ){
+            uint8_t header[header_size];
+            peek( position, header, header_size );
+            const uint16_t message_length = static_cast<uint16_t>( header[0] | ( header[1] << 8 ) );
+
+            if( length + message_length > max_batch_size )
+                break;
+
+            peek( position + header_size, &batch_[length], message_length );
+            length += message_length;
+            position += header_size + message_length;
+            messages++;
+        }
+
+        const uint64_t cost = static_cast<uint64_t>( length ) * 1000000;
+        if( tokens_ < cost ){
+            const uint64_t wait_ms = ( ( cost - tokens_ ) / rate_ + 999 ) / 1000;
+            return wait_ms > 0 ? static_cast<uint32_t>( wait_ms ) : 1;
+        }
+
+        if( sink_( sink_user_data_, batch_, length ) != 0 ){
+            statistics_.sink_busy++;
+            return retry_interval_ms;
+        }
+
+        tokens_ -= cost;
+        consume( position );
+
+        statistics_.batches++;
+        statistics_.sent += messages;
+    }
+}
+
+
+void OutboundQueue::peek( const size_t position, uint8_t* const destination, const size_t length ) const{
+
+    const size_t flash_used = flash_used_;
+    size_t copied = 0;
+
+    // Oldest bytes from flash
+    while( copied < length && position + copied < flash_used ){
+        const size_t offset = ( flash_head_ + position + copied ) % flash_size_;
+        size_t chunk = flash_size_ - offset;
+        if( chunk > flash_used - position - copied ) chunk = flash_used - position - copied;
+        if( chunk > length - copied ) chunk = length - copied;
+
+        memcpy( destination + copied, reinterpret_cast<const uint8_t*>( XIP_BASE + flash_offset_ + offset ), chunk );
+        copied += chunk;
+    }
+
+    // Rest from buffer
+    while( copied < length ){
+        const size_t offset = ( head_ + position + copied - flash_used ) % size_;
+        size_t chunk = size_ - offset;
+        if( chunk > length - copied ) chunk = length - copied;
+
+        memcpy( destination + copied, &buffer_[offset], chunk );
+        copied += chunk;
+    }
+}
+
+
+void OutboundQueue::consume( size_t length ){
+    const uint32_t interrupts = save_and_disable_interrupts();
+
+    const size_t from_flash = length < flash_used_ ? length : flash_used_;
+    const size_t from_buffer = length - from_flash;
+
+    // Offsets stay below the region sizes, so they never wrap
+    if( from_flash > 0 ){
+        flash_head_ = ( flash_head_ + from_flash ) % flash_size_;
+        flash_used_ = flash_used_ - from_flash;
+    }
+    if( from_buffer > 0 ){
+        head_ = ( head_ + from_buffer ) % size_;
+        used_ = used_ - from_buffer;
+    }
+
+    restore_interrupts( interrupts );
+}
+
+
+void OutboundQueue::updatePeak( void ){
+    const size_t bytes = used_ + flash_used_;
+    if( bytes > statistics_.peak ){
+        statistics_.peak = bytes;
+    }
+}
+
+
+void OutboundQueue::linkChanged( void* user_data, const bool link_up ){
+    OutboundQueue* const queue = static_cast<OutboundQueue*>( user_data );
+
+    if( link_up ){
+        async_context_set_work_pending( cyw43_arch_async_context(), &queue->drain_worker_ );
+    }
+}
+
+
+void OutboundQueue::drainWork( async_context_t* context, async_when_pending_worker_t* worker ){
+    static_cast<OutboundQueue*>( worker->user_data )->service();
+}
+
+
+void OutboundQueue::retryWork( async_context_t* context, async_at_time_worker_t* worker ){
+    static_cast<OutboundQueue*>( worker->user_data )->service();
+}
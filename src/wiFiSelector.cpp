@@ -0,0 +1,278 @@
+/*!
+ * @file wiFiSelector.cpp
+ * @author janwolzenburg
+ * @brief Implementation of AccessPointSelector class
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <string.h>
+#include <limits.h>
+#include "wiFiSelector.h"
+#include "wiFiStation.h"
+
+
+AccessPointSelector::AccessPointSelector( const string ssid, const Weights weights ) :
+    ssid_( ssid ),
+    weights_( weights ),
+    candidates_{},
+    candidate_count_( 0 ),
+    top_{},
+    top_count_( 0 ),
+    channels_{}
+{
+    if( ssid_.length() > ssid_size ){
+        ssid_.erase( ssid_size );
+    }
+}
+
+
+AccessPointSelector::AccessPointSelector( const string ssid ) :
+    AccessPointSelector{ ssid, Weights{} }
+{}
+
+
+void AccessPointSelector::beginScan( void ){
+
+    for( size_t i = 0; i < candidate_count_; i++ ){
+        candidates_[i].seen = false;
+    }
+
+    channels_.beginScan();
+}
+
+
+void AccessPointSelector::addResult( const cyw43_ev_scan_result_t& result ){
+
+    // Every access point loads its channel, also those of other networks
+    channels_.addResult( result );
+
+    const size_t ssid_length = result.ssid_len < ssid_size ? result.ssid_len : ssid_size;
+    if( !ssid_.empty() && ( ssid_.length() != ssid_length || memcmp( ssid_.data(), result.ssid, ssid_length ) != 0 ) ){
+        return;
+    }
+
+    int index = find( result.bssid );
+
+    // Result for the same access point in this scan. Keep the stronger one
+    if( index >= 0 && candidates_[index].seen && candidates_[index].rssi >= result.rssi ){
+        return;
+    }
+
+    if( index < 0 ){
+
+        if( candidate_count_ < max_candidates ){
+            index = static_cast<int>( candidate_count_++ );
+        }
+        else{
+            // Replace weakest access point when the new one is stronger
+            index = 0;
+            for( size_t i = 1; i < candidate_count_; i++ ){
+                if( candidates_[i].smoothed_rssi < candidates_[index].smoothed_rssi ) index = static_cast<int>( i );
+            }
+            if( candidates_[index].smoothed_rssi >= result.rssi * 16 ){
+                return;
+            }
+
+            // Candidate leaves the top list
+            for( size_t i = 0; i < top_count_; i++ ){
+                if( top_[i] == static_cast<size_t>( index ) ){
+                    memmove( &top_[i], &top_[i + 1], ( top_count_ - i - 1 ) * sizeof( top_[0] ) );
+                    top_count_--;
+                    break;
+                }
+            }
+        }
+
+        Candidate& candidate = candidates_[index];
+        candidate = Candidate{};
+        memcpy( candidate.bssid, result.bssid, sizeof( candidate.bssid ) );
+        candidate.smoothed_rssi = result.rssi * 16;
+    }
+
+    Candidate& candidate = candidates_[index];
+
+    // Same access point twice in one scan replaces the earlier sample
+    if( !candidate.seen ){
+        // Exponential average with weight 1/4 for new sample
+        candidate.smoothed_rssi += ( result.rssi * 16 - candidate.smoothed_rssi ) / 4;
+    }
+
+    memcpy( candidate.ssid, result.ssid, ssid_length );
+    candidate.ssid[ssid_length] = '\0';
+    candidate.channel = static_cast<uint8_t>( result.channel );
+    candidate.auth_mode = result.auth_mode;
+    candidate.authentification = WiFiStation::getAuthentificationFromScanResult( result.auth_mode );
+    candidate.rssi = result.rssi;
+    candidate.missed_scans = 0;
+    candidate.seen = true;
+    candidate.score = score( candidate );
+
+    updateTop( static_cast<size_t>( index ) );
+}
+
+
+void AccessPointSelector::endScan( void ){
+
+    // Forget access points not seen for too long
+    size_t kept = 0;
+    for( size_t i = 0; i < candidate_count_; i++ ){
+        Candidate& candidate = candidates_[i];
+
+        if( !candidate.seen && ++candidate.missed_scans > max_missed_scans ){
+            continue;
+        }
+
+        if( kept != i ){
+            candidates_[kept] = candidate;
+        }
+        kept++;
+    }
+    candidate_count_ = kept;
+
+    channels_.endScan();
+
+    // Congestion is only complete now
+    for( size_t i = 0; i < candidate_count_; i++ ){
+        candidates_[i].score = score( candidates_[i] );
+    }
+
+    rebuildTop();
+}
+
+
+void AccessPointSelector::reportConnectResult( const uint8_t bssid[6], const bool success ){
+
+    const int index = find( bssid );
+    if( index < 0 )
+        return;
+
+    Candidate& candidate = candidates_[index];
+
+    // Halve history before overflow so recent attempts keep their weight
+    if( candidate.attempts == UINT16_MAX ){
+        candidate.attempts /= 2;
+        candidate.successes /= 2;
+    }
+
+    candidate.attempts++;
+    if( success ) candidate.successes++;
+
+    candidate.score = score( candidate );
+    rebuildTop();
+}
+
+
+const AccessPointSelector::Candidate* AccessPointSelector::best( const string& ssid, const uint32_t authentification ) const{
+
+    const Candidate* best_candidate = nullptr;
+    for( size_t i = 0; i < candidate_count_; i++ ){
+        const Candidate& candidate = candidates_[i];
+
+        if( candidate.score == INT32_MIN || ssid != candidate.ssid ||
+            !WiFiStation::isAuthentificationCompatible( authentification, candidate.auth_mode ) ){
+            continue;
+        }
+
+        if( best_candidate == nullptr || candidate.score > best_candidate->score ){
+            best_candidate = &candidate;
+        }
+    }
+
+    return best_candidate;
+}
+
+
+void AccessPointSelector::clear( void ){
+    candidate_count_ = 0;
+    top_count_ = 0;
+    channels_.clear();
+}
+
+
+int AccessPointSelector::find( const uint8_t bssid[6] ) const{
+    for( size_t i = 0; i < candidate_count_; i++ ){
+        if( memcmp( candidates_[i].bssid, bssid, sizeof( candidates_[i].bssid ) ) == 0 ){
+            return static_cast<int>( i );
+        }
+    }
+    return -1;
+}
+
+
+int32_t AccessPointSelector::score( const Candidate& candidate ) const{
+
+    // Cannot connect at all
+    if( !WiFiStation::isAuthentificationSupported( candidate.auth_mode ) ){
+        return INT32_MIN;
+    }
+
+    // -90 dBm to -30 dBm onto 0..100
+    int32_t rssi_score = ( candidate.smoothed_rssi / 16 + 90 ) * 100 / 60;
+    if( rssi_score < 0 ) rssi_score = 0;
+    if( rssi_score > 100 ) rssi_score = 100;
+
+    // TKIP only networks fall back to legacy rates
+    const int32_t authentification_score = candidate.authentification == CYW43_AUTH_WPA_TKIP_PSK ? 50 : 100;
+
+    // Interference from all access points on overlapping channels in this scan, without the candidate itself
+    int32_t interference = channels_.currentInterference( candidate.channel );
+    if( candidate.seen && candidate.rssi > ChannelAnalytics::rssi_bin_floor ){
+        interference -= candidate.rssi - ChannelAnalytics::rssi_bin_floor;
+    }
+
+    // About six strong neighbours make a channel useless
+    int32_t congestion_score = 100 - interference / 3;
+    if( congestion_score < 0 ) congestion_score = 0;
+    if( congestion_score > 100 ) congestion_score = 100;
+
+    // Unknown access points start at 50
+    const int32_t history_score = ( static_cast<int32_t>( candidate.successes ) + 1 ) * 100 / ( static_cast<int32_t>( candidate.attempts ) + 2 );
+
+    return rssi_score * weights_.rssi + 
+           authentification_score * weights_.authentification +
+           congestion_score * weights_.congestion +
+           history_score * weights_.history;
+}
+
+
+void AccessPointSelector::updateTop( const size_t index ){
+
+    // Remove if already listed
+    for( size_t i = 0; i < top_count_; i++ ){
+        if( top_[i] == index ){
+            memmove( &top_[i], &top_[i + 1], ( top_count_ - i - 1 ) * sizeof( top_[0] ) );
+            top_count_--;
+            break;
+        }
+    }
+
+    const int32_t candidate_score = candidates_[index].score;
+    if( candidate_score == INT32_MIN )
+        return;
+
+    // Find position
+    size_t position = 0;
+    while( position < top_count_ && candidates_[top_[position]].score >= candidate_score ){
+        position++;
+    }
+
+    if( position >= top_k )
+        return;
+
+    // Shift weaker candidates down. Last one drops out when full
+    const size_t moved = ( top_count_ < top_k ? top_count_ : top_k - 1 ) - position;
+    memmove( &top_[position + 1], &top_[position], moved * sizeof( top_[0] ) );
+    top_[position] = index;
+
+    if( top_count_ < top_k ) top_count_++;
+}
+
+
+void AccessPointSelector::rebuildTop( void ){
+    top_count_ = 0;
+    for( size_t i = 0; i < candidate_count_; i++ ){
+        updateTop( i );
+    }
+}
@@ -0,0 +1,213 @@
+/*!
+ * @file wiFiSession.cpp
+ * @author janwolzenburg
+ * @brief Implementation of TcpSession class
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include "pico/time.h"
+#include "lwip/pbuf.h"
+#include "wiFiSession.h"
+#include "wiFiStation.h"
+
+
+TcpSession::TcpSession( const uint32_t backoff_initial_ms, const uint32_t backoff_maximum_ms ) :
+    connection_{},
+    address_{},
+    port_( 0 ),
+    open_( false ),
+    link_up_( WiFiStation::connectionState() == WiFiStation::ConnectionState::connected ),
+    backoff_initial_ms_( backoff_initial_ms > 0 ? backoff_initial_ms : 1 ),
+    backoff_maximum_ms_( backoff_maximum_ms > backoff_initial_ms ? backoff_maximum_ms : backoff_initial_ms ),
+    backoff_ms_( backoff_initial_ms_ ),
+    lost_at_( 0 ),
+    link_up_at_( 0 ),
+    statistics_{},
+    receive_handler_( nullptr ),
+    sent_handler_( nullptr ),
+    state_handler_( nullptr ),
+    user_data_( nullptr ),
+    link_worker_{},
+    retry_worker_{}
+{
+    link_worker_.do_work = linkWork;
+    link_worker_.user_data = this;
+    retry_worker_.do_work = retryWork;
+    retry_worker_.user_data = this;
+
+    connection_.setHandlers( received, sent, stateChanged, this );
+
+    // The worker defers aborting and reconnecting
+    WiFiStation::addLinkWorker( &link_worker_, linkChanged, this );
+}
+
+
+TcpSession::~TcpSession( void ){
+    WiFiStation::removeLinkWorker( &link_worker_, linkChanged, this );
+
+    LwipLock lock;
+
+    open_ = false;
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &retry_worker_ );
+
+    state_handler_ = nullptr;
+    connection_.abort();
+}
+
+
+void TcpSession::setHandlers( const TcpConnection::receive_handler_t receive_handler, const TcpConnection::sent_handler_t sent_handler,
+                              const TcpConnection::state_handler_t state_handler, void* user_data ){
+    LwipLock lock;
+    receive_handler_ = receive_handler;
+    sent_handler_ = sent_handler;
+    state_handler_ = state_handler;
+    user_data_ = user_data;
+}
+
+
+int TcpSession::open( const ip_addr_t& address, const uint16_t port ){
+
+    if( port == 0 )
+        return -1;
+
+    LwipLock lock;
+
+    if( open_ )
+        return -1;
+
+    address_ = address;
+    port_ = port;
+    open_ = true;
+    backoff_ms_ = backoff_initial_ms_;
+    lost_at_ = 0;
+    link_up_at_ = time_us_64();
+
+    if( link_up_ ){
+        attempt();
+    }
+
+    return 0;
+}
+
+
+void TcpSession::close( void ){
+
+    LwipLock lock;
+
+    open_ = false;
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &retry_worker_ );
+
+    connection_.close();
+}
+
+
+void TcpSession::attempt( void ){
+
+    if( !open_ || !link_up_ || connection_.isOpen() )
+        return;
+
+    if( connection_.connect( address_, port_ ) != 0 ){
+        statistics_.failures++;
+        scheduleRetry();
+    }
+}
+
+
+void TcpSession::scheduleRetry( void ){
+
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &retry_worker_ );
+    async_context_add_at_time_worker_in_ms( cyw43_arch_async_context(), &retry_worker_, backoff_ms_ );
+
+    backoff_ms_ = backoff_ms_ > backoff_maximum_ms_ / 2 ? backoff_maximum_ms_ : 2 * backoff_ms_;
+}
+
+
+void TcpSession::linkChanged( void* user_data, const bool link_up ){
+    TcpSession* const session = static_cast<TcpSession*>( user_data );
+
+    session->link_up_ = link_up;
+    async_context_set_work_pending( cyw43_arch_async_context(), &session->link_worker_ );
+}
+
+
+void TcpSession::linkWork( async_context_t* context, async_when_pending_worker_t* worker ){
+    TcpSession* const session = static_cast<TcpSession*>( worker->user_data );
+
+    if( !session->open_ )
+        return;
+
+    async_context_remove_at_time_worker( context, &session->retry_worker_ );
+    session->backoff_ms_ = session->backoff_initial_ms_;
+
+    if( session->link_up_ ){
+        session->link_up_at_ = time_us_64();
+        session->attempt();
+        return;
+    }
+
+    // The pcb is useless without link. Retransmissions would only delay the reconnect
+    if( session->connection_.isOpen() ){
+        session->statistics_.link_aborts++;
+        session->connection_.abort();
+    }
+}
+
+
+void TcpSession::retryWork( async_context_t* context, async_at_time_worker_t* worker ){
+    static_cast<TcpSession*>( worker->user_data )->attempt();
+}
+
+
+void TcpSession::received( void* user_data, struct pbuf* chain ){
+    TcpSession* const session = static_cast<TcpSession*>( user_data );
+
+    if( session->receive_handler_ != nullptr ){
+        session->receive_handler_( session->user_data_, chain );
+    }
+    else{
+        pbuf_free( chain );
+    }
+}
+
+
+void TcpSession::sent( void* user_data, uint16_t acknowledged ){
+    TcpSession* const session = static_cast<TcpSession*>( user_data );
+
+    if( session->sent_handler_ != nullptr ){
+        session->sent_handler_( session->user_data_, acknowledged );
+    }
+}
+
+
+void TcpSession::stateChanged( void* user_data, bool connected, err_t error ){
+    TcpSession* const session = static_cast<TcpSession*>( user_data );
+    const uint64_t now = time_us_64();
+
+    if( connected ){
+        session->statistics_.connects++;
+        session->statistics_.last_resume_us = now - session->link_up_at_;
+        if( session->lost_at_ != 0 ){
+            session->statistics_.last_outage_us = now - session->lost_at_;
+        }
+
+        session->lost_at_ = 0;
+        session->backoff_ms_ = session->backoff_initial_ms_;
+    }
+    else{
+        if( session->lost_at_ == 0 ){
+            session->lost_at_ = now;
+        }
+
+        // Retry failed attempts and remote closes. Link loss is handled by the link worker
+        if( session->open_ && session->link_up_ ){
+            session->statistics_.failures++;
+            session->scheduleRetry();
+        }
+    }
+
+    if( session->state_handler_ != nullptr ){
+        session->state_handler_( session->user_data_, connected, error );
+    }
+}
@@ -7,9 +7,12 @@
  * 
  */
 
+#include <string.h>
 #include <algorithm>
 #include "hardware/watchdog.h"
 #include "wiFiStation.h"
+#include "wiFiSelector.h"
+#include "wiFiTrace.h"
 
 #ifdef DEBUG
     #define DEPUG_PRINTF(...) printf("DEBUG: " __VA_ARGS__)
@@ -19,27 +22,77 @@
 
 
 uint32_t WiFiStation::connection_check_interval_us = 1000000;
-
-bool WiFiStation::one_instance_connecting_ = false;
-bool WiFiStation::one_instance_connected_ = false;
-int WiFiStation::last_connection_state_ = -10;
-WiFiStation* WiFiStation::connected_station_ = nullptr;
+uint32_t WiFiStation::join_check_interval_us = 100000;
+
+WiFiStation::state_config_t WiFiStation::state_table_[] = {
+    { "idle",       0,      Escalation::none },
+    { "joining",    15000,  Escalation::backoff },
+    { "no IP",      10000,  Escalation::rejoin },
+    { "connected",  0,      Escalation::none },
+    { "backoff",    0,      Escalation::join }      // Deadline is the current backoff
+};
+
+// Columns are link status CYW43_LINK_BADAUTH ( -3 ) to CYW43_LINK_UP ( 3 ):
+// BADAUTH, NONET, FAIL, DOWN, JOIN, NOIP, UP
+const WiFiStation::ConnectionState WiFiStation::transition_table_[][7] = {
+    // idle. Link status is not checked
+    { ConnectionState::idle, ConnectionState::idle, ConnectionState::idle, ConnectionState::idle,
+      ConnectionState::idle, ConnectionState::idle, ConnectionState::idle },
+    // joining
+    { ConnectionState::backoff, ConnectionState::backoff, ConnectionState::backoff, ConnectionState::joining,
+      ConnectionState::joining, ConnectionState::no_ip, ConnectionState::connected },
+    // no_ip
+    { ConnectionState::backoff, ConnectionState::backoff, ConnectionState::backoff, ConnectionState::joining,
+      ConnectionState::joining, ConnectionState::no_ip, ConnectionState::connected },
+    // connected. Losing the IP keeps the link
+    { ConnectionState::backoff, ConnectionState::backoff, ConnectionState::backoff, ConnectionState::joining,
+      ConnectionState::joining, ConnectionState::connected, ConnectionState::connected },
+    // backoff. Stale link status of the failed join is ignored
+    { ConnectionState::backoff, ConnectionState::backoff, ConnectionState::backoff, ConnectionState::backoff,
+      ConnectionState::backoff, ConnectionState::backoff, ConnectionState::backoff }
+};
+
+WiFiStation::ConnectionState WiFiStation::state_ = ConnectionState::idle;
+uint64_t WiFiStation::state_entered_ = 0;
+int WiFiStation::link_status_ = -10;
+WiFiStation* WiFiStation::active_station_ = nullptr;
+
+uint32_t WiFiStation::backoff_initial_ms_ = 1000;
+uint32_t WiFiStation::backoff_maximum_ms_ = 32000;
+uint32_t WiFiStation::backoff_ms_ = 1000;
+uint32_t WiFiStation::current_backoff_ms_ = 0;
+
+WiFiStation::transition_callback_t WiFiStation::transition_callback_ = nullptr;
+void* WiFiStation::transition_user_data_ = nullptr;
+WiFiStation::transition_t WiFiStation::transitions_[transition_trace_size] = {};
+size_t WiFiStation::transition_count_ = 0;
+
+WiFiStation::InitStage WiFiStation::init_stage_ = InitStage::none;
+WiFiStation::BootTiming WiFiStation::boot_timing_ = BootTiming{};
+uint64_t WiFiStation::stage_started_ = 0;
+WiFiStation* WiFiStation::init_station_ = nullptr;
 
 #ifdef USE_POLLING
 uint64_t WiFiStation::last_connection_check_ = 0;
 bool WiFiStation::check_connection_ = false;
+uint64_t WiFiStation::next_deadline_ = 0;
 #else
-repeating_timer_t WiFiStation::connection_check_timer_ = repeating_timer_t{};
+async_at_time_worker_t WiFiStation::connection_check_worker_ = async_at_time_worker_t{};
 #endif
 
 vector<cyw43_ev_scan_result_t> WiFiStation::available_wifis_ = vector<cyw43_ev_scan_result_t>( 0, cyw43_ev_scan_result_t{} );
+AccessPointSelector* WiFiStation::selector_ = nullptr;
+uint8_t WiFiStation::join_bssid_[6] = {};
+bool WiFiStation::join_reported_ = true;
+bool WiFiStation::scan_pending_ = false;
+vector<WiFiStation::link_listener_t> WiFiStation::link_listeners_ = vector<WiFiStation::link_listener_t>( 0, link_listener_t{} );
+size_t WiFiStation::heap_peak_ = 0;
 
 
 WiFiStation::WiFiStation( const string ssid, const string password, const uint32_t authentification ) : 
     ssid_( ssid ),
     password_( password ),
-    authentification_( authentification ),
-    connected_( false )
+    authentification_( authentification )
 {
     if( ssid_.length() > ssid_size ){
         ssid_.erase( ssid_size );
@@ -71,65 +124,82 @@ WiFiStation::WiFiStation( void ) :
 
 WiFiStation::~WiFiStation( void ){
     disconnect();
+    stopConnecting();
 }
 
 
 WiFiStation& WiFiStation::operator=( WiFiStation&& wifi_station ){
-    
-    stopConnectionCheck();
 
     // Disconnect this station before copying from other
-    if( connected_ )
+    if( active_station_ == this ){
         this->disconnect();
+        this->stopConnecting();
+    }
 
     // Copy data
     ssid_ = wifi_station.ssid_;
     password_ = wifi_station.password_;
     authentification_ = wifi_station.authentification_;
-    connected_ = wifi_station.connected_;
 
-    // If active station is source update pointer to this
-    if( connected_station_ == &wifi_station ){
-        connected_station_ = this;
+    // If active station is source update pointer to this. State machine keeps running
+    if( active_station_ == &wifi_station ){
+        active_station_ = this;
     }
 
-    startConnectionCheck();
     return *this;
 
 }
 
 
 int WiFiStation::initialise( uint32_t country ){
-    int return_code = cyw43_arch_init_with_country( country );
+    boot_timing_ = BootTiming{};
+    boot_timing_.started_us = time_us_64();
+    init_station_ = nullptr;
+
+    int return_code = startDriver( country );
     if( return_code != 0 ){
-        DEPUG_PRINTF( "CYW43 initialisatiion failed with %i\r\n", return_code );
         return return_code;
     }
 
-    // Enter station mode
-    cyw43_arch_enable_sta_mode();
+    bringUpChip();
 
-    #ifndef USE_POLLING
-    // Cancel timer if registered
-    cancel_repeating_timer( &connection_check_timer_ );
-    #endif
+    return 0;
 
-    
-    #ifdef USE_WATCHDOG
-    if( watchdog_caused_reboot() ){
-        DEPUG_PRINTF("Rebooted by watchdog\r\n");
+}
+
+
+int WiFiStation::startInitialise( uint32_t country, WiFiStation* const station ){
+    boot_timing_ = BootTiming{};
+    boot_timing_.started_us = time_us_64();
+    init_station_ = station;
+
+    int return_code = startDriver( country );
+    if( return_code != 0 ){
+        return return_code;
     }
-    #endif
 
+    // Chip is brought up in next poll() or finishInitialise()
     return 0;
+}
+
+
+int WiFiStation::finishInitialise( void ){
+    if( init_stage_ == InitStage::driver ){
+        advanceInitialise();
+    }
 
+    return init_stage_ == InitStage::none || init_stage_ == InitStage::failed ? -1 : 0;
 }
 
 
 void WiFiStation::deinitialise( void ){
-    if( connected_station_ != nullptr ){
-        connected_station_->disconnect();
+    if( active_station_ != nullptr ){
+        active_station_->disconnect();
+        active_station_->stopConnecting();
     }
+
+    init_stage_ = InitStage::none;
+    init_station_ = nullptr;
     cyw43_arch_deinit();
 }
 
@@ -138,182 +208,376 @@ int WiFiStation::scanForWifis( void ){
 
     cyw43_wifi_scan_options_t scan_options = {0};
 
+    // Results and selector are used by the driver and the connection check
+    cyw43_arch_lwip_begin();
+
     available_wifis_.clear();
 
+    if( selector_ != nullptr ){
+        selector_->beginScan();
+    }
+
     int scan_error = cyw43_wifi_scan( &cyw43_state, &scan_options, static_cast<void*>( &available_wifis_ ), scanResult );
+    TRACE_RECORD( LinkTrace::Type::scan_start, static_cast<int8_t>( scan_error ) );
     
+    scan_pending_ = ( scan_error == 0 );
+
+    #ifndef USE_POLLING
+    // Connection check finishes the scan. It does not run while idle
+    if( scan_pending_ && state_ == ConnectionState::idle ){
+        startConnectionCheck( join_check_interval_us );
+    }
+    #endif
+
+    cyw43_arch_lwip_end();
+
     return scan_error;
     
 }
 
 
+void WiFiStation::releaseScanResults( void ){
+    cyw43_arch_lwip_begin();
+    vector<cyw43_ev_scan_result_t>().swap( available_wifis_ );
+    cyw43_arch_lwip_end();
+}
+
+
 bool WiFiStation::isScanActive( void ){
-    return cyw43_wifi_scan_active( &cyw43_state );
+    const bool active = cyw43_wifi_scan_active( &cyw43_state );
+    
+    if( !active ){
+        finishScan();
+    }
+
+    return active;
 }
 
 
 vector<cyw43_ev_scan_result_t> WiFiStation::getAvailableWifis( void ){
 
+    if( !cyw43_wifi_scan_active( &cyw43_state ) ){
+        finishScan();
+    }
+
+    cyw43_arch_lwip_begin();
+
     std::sort(  available_wifis_.begin(), available_wifis_.end(), 
                 [](const cyw43_ev_scan_result_t& a, const cyw43_ev_scan_result_t& b)
                     { return a.rssi > b.rssi; });
 
-    return available_wifis_;
+    vector<cyw43_ev_scan_result_t> wifis = available_wifis_;
+
+    cyw43_arch_lwip_end();
+
+    return wifis;
 }
 
 
 uint32_t WiFiStation::getAuthentificationFromScanResult( const uint8_t authentification_from_scan ){
-    uint32_t real_authentification_mode = CYW43_AUTH_OPEN;
-                    
-    // Don't know if this is correct
-    switch( authentification_from_scan ){
-        default:
-            real_authentification_mode = CYW43_AUTH_OPEN;
-        break;
-        case 1: // WEP_PSK ???
-            real_authentification_mode = CYW43_AUTH_WPA_TKIP_PSK;
-        break;
-        case 3: // WEP_PSK + WPA ???
-            real_authentification_mode = CYW43_AUTH_WPA_TKIP_PSK;
-        break;
-        case 5: // WEP_PSK + WPA2 ??? This works
-            real_authentification_mode = CYW43_AUTH_WPA2_MIXED_PSK;
-        break;
     
+    // The driver sets the privacy bit for every encrypted network and adds one bit per WPA or RSN element found.
+    // WPA2 mixed mode accepts AES and TKIP and also joins WPA2 only networks
+    if( authentification_from_scan & scan_auth_wpa2 ){
+        return CYW43_AUTH_WPA2_MIXED_PSK;
+    }
+
+    if( authentification_from_scan & scan_auth_wpa ){
+        return CYW43_AUTH_WPA_TKIP_PSK;
+    }
+
+    // Open. WEP only is not supported, see isAuthentificationSupported()
+    return CYW43_AUTH_OPEN;
+}
+
+
+bool WiFiStation::isAuthentificationSupported( const uint8_t authentification_from_scan ){
+
+    // Privacy without WPA or RSN element is WEP
+    if( ( authentification_from_scan & scan_auth_privacy ) && 
+        !( authentification_from_scan & ( scan_auth_wpa | scan_auth_wpa2 ) ) ){
+        return false;
+    }
+
+    return true;
+}
+
+
+bool WiFiStation::isAuthentificationCompatible( const uint32_t authentification, const uint8_t authentification_from_scan ){
+
+    if( !isAuthentificationSupported( authentification_from_scan ) )
+        return false;
+
+    switch( authentification ){
+        case CYW43_AUTH_OPEN:
+            return !( authentification_from_scan & scan_auth_privacy );
+
+        case CYW43_AUTH_WPA_TKIP_PSK:
+            return ( authentification_from_scan & scan_auth_wpa ) != 0;
+
+        case CYW43_AUTH_WPA2_AES_PSK:
+        case CYW43_AUTH_WPA2_MIXED_PSK:
+            return ( authentification_from_scan & scan_auth_wpa2 ) != 0;
+
+        default:
+            return false;
+    }
+}
+
+
+void WiFiStation::setAccessPointSelector( AccessPointSelector* const selector ){
+    selector_ = selector;
+    join_reported_ = true;
+}
+
+
+int WiFiStation::addLinkCallback( const link_callback_t callback, void* const user_data ){
+    if( callback == nullptr )
+        return -1;
+
+    // notifyLink() walks the listeners in lwIP context
+    cyw43_arch_lwip_begin();
+    link_listeners_.push_back( link_listener_t{ callback, user_data } );
+    updateHeapPeak();
+    cyw43_arch_lwip_end();
+
+    return 0;
+}
+
+
+void WiFiStation::removeLinkCallback( const link_callback_t callback, void* const user_data ){
+    cyw43_arch_lwip_begin();
+    link_listeners_.erase( std::remove_if( link_listeners_.begin(), link_listeners_.end(),
+                                           [&]( const link_listener_t& listener )
+                                                { return listener.callback == callback && listener.user_data == user_data; } ),
+                           link_listeners_.end() );
+    cyw43_arch_lwip_end();
+}
+
+
+int WiFiStation::addLinkWorker( async_when_pending_worker_t* const worker, const link_callback_t callback, void* const user_data ){
+    async_context_t* const context = cyw43_arch_async_context();
+    if( context == nullptr || worker == nullptr || callback == nullptr )
+        return -1;
+
+    cyw43_arch_lwip_begin();
+    async_context_add_when_pending_worker( context, worker );
+    const int result = addLinkCallback( callback, user_data );
+    cyw43_arch_lwip_end();
+
+    return result;
+}
+
+
+void WiFiStation::removeLinkWorker( async_when_pending_worker_t* const worker, const link_callback_t callback, void* const user_data ){
+    async_context_t* const context = cyw43_arch_async_context();
+    if( context == nullptr )
+        return;
+
+    cyw43_arch_lwip_begin();
+    removeLinkCallback( callback, user_data );
+    async_context_remove_when_pending_worker( context, worker );
+    cyw43_arch_lwip_end();
+}
+
+
+const char* WiFiStation::stateName( const ConnectionState state ){
+    if( state >= ConnectionState::count )
+        return "invalid";
+
+    return state_table_[static_cast<size_t>( state )].name;
+}
+
+
+void WiFiStation::setStateTimeout( const ConnectionState state, const uint32_t timeout_ms ){
+    // A deadline without escalation would expire forever
+    if( state >= ConnectionState::count || state == ConnectionState::backoff ||
+        state_table_[static_cast<size_t>( state )].escalation == Escalation::none )
+        return;
+
+    state_table_[static_cast<size_t>( state )].timeout_ms = timeout_ms;
+}
+
+
+void WiFiStation::setBackoff( const uint32_t initial_ms, const uint32_t maximum_ms ){
+    backoff_initial_ms_ = initial_ms;
+    backoff_maximum_ms_ = std::max( initial_ms, maximum_ms );
+    backoff_ms_ = backoff_initial_ms_;
+}
+
+
+void WiFiStation::setTransitionCallback( const transition_callback_t callback, void* const user_data ){
+    transition_callback_ = callback;
+    transition_user_data_ = user_data;
+}
+
+
+size_t WiFiStation::getTransitions( transition_t* const transitions, const size_t max_count ){
+    if( transitions == nullptr )
+        return 0;
+
+    const size_t count = std::min( std::min( transition_count_, transition_trace_size ), max_count );
+
+    // Newest transitions, oldest first
+    for( size_t i = 0; i < count; i++ ){
+        transitions[i] = transitions_[( transition_count_ - count + i ) % transition_trace_size];
     }
 
-    return real_authentification_mode;
+    return count;
 }
 
 
 int WiFiStation::connect( const bool is_reconnect ){
 
+    TRACE_RECORD( LinkTrace::Type::connect, is_reconnect, &authentification_, sizeof( authentification_ ) );
+
     // Already connected
-    if( connected_ ){
+    if( connected() ){
         DEPUG_PRINTF( "This station already connected!\r\n" );
         return 0;
     }
 
     // Connected via different instance or connection is in progress
-    if( one_instance_connected_ || one_instance_connecting_ ){
+    if( state_ != ConnectionState::idle ){
         DEPUG_PRINTF( "Different station already connected or trying to connect!\r\n" );
         return -1;
     }
-        
 
-    // Local char pointer for password
-    const char* password = nullptr;
 
     // Check if password is giebn when necessary
-    if( authentification_ != CYW43_AUTH_OPEN ){
-        if( password_.empty() ){
-            DEPUG_PRINTF( "Password cannot be ampty when network is not open!\r\n" );
-            return -1; 
-        }
-        password = password_.c_str();
-    } 
+    if( authentification_ != CYW43_AUTH_OPEN && password_.empty() ){
+        DEPUG_PRINTF( "Password cannot be ampty when network is not open!\r\n" );
+        return -1;
+    }
 
-    // SSID given? 
+    // SSID given?
     if( ssid_.empty() ){
         DEPUG_PRINTF("No SSID given!\r\n");
         return -1;
     }
-        
-    
+
+
     // Authetification valid?
     if( authentification_ != CYW43_AUTH_OPEN &&
         authentification_ != CYW43_AUTH_WPA2_AES_PSK &&
         authentification_ != CYW43_AUTH_WPA2_MIXED_PSK &&
         authentification_ != CYW43_AUTH_WPA_TKIP_PSK ){
-        
+
         DEPUG_PRINTF("Authentification mode invalid!\r\n");
         return -1;
     }
 
-    one_instance_connecting_ = true;
-    connected_station_ = this;
+    // Keep state machine and connection check from running in between
+    cyw43_arch_lwip_begin();
 
-    DEPUG_PRINTF("Connecting...\r\n");
+    active_station_ = this;
+    updateHeapPeak();
 
-    // Force leave of wifi before connecting to new
-    cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
+    if( !is_reconnect ){
+        backoff_ms_ = backoff_initial_ms_;
+    }
 
     // Try to connect non blocking
-    int connection_status = cyw43_arch_wifi_connect_async(  ssid_.c_str(), 
-                                                            password, 
-                                                            authentification_ );
-
-    if( connection_status != 0 ){
-        DEPUG_PRINTF( "Could not start to connect. Error %u\r\n", connection_status );
+    if( startJoin() != 0 ){
+        active_station_ = nullptr;
+        cyw43_arch_lwip_end();
         return -1;
     }
 
-    // Add repeating timer. Longer interval when reconnecting
-    if( startConnectionCheck( is_reconnect ? connection_check_interval_us * 4 : connection_check_interval_us ) == false ){
-        DEPUG_PRINTF( "Repeating timer for connection check could not be started!\r\n" );   
+    // Start connection check
+    if( startConnectionCheck( join_check_interval_us ) == false ){
+        DEPUG_PRINTF( "Connection check could not be started!\r\n" );
+        cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
+        active_station_ = nullptr;
+        cyw43_arch_lwip_end();
         return -1;
     }
 
+    transition( ConnectionState::joining, TransitionCause::request );
+
+    cyw43_arch_lwip_end();
     return 0;
 }
 
 
 int WiFiStation::disconnect( void ){
-    
-    if( !connected_ )
+
+    TRACE_RECORD( LinkTrace::Type::disconnect, 0 );
+
+    if( !connected() )
         return -1;
-    
-    stopConnectionCheck();
-    cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
-    connected_ = false;
-    one_instance_connected_ = false;
-    connected_station_ = nullptr;
+
+    cyw43_arch_lwip_begin();
+    transition( ConnectionState::idle, TransitionCause::request );
+    cyw43_arch_lwip_end();
 
     return 0;
 }
 
 
-bool WiFiStation::connected( const bool refresh_now ){ 
+bool WiFiStation::connected( const bool refresh_now ){
     if( refresh_now ){
-        #ifdef USE_POLLING
+        cyw43_arch_lwip_begin();
         checkConnection();
-        #else
-        checkConnection( &connection_check_timer_ );
-        #endif
+        cyw43_arch_lwip_end();
     }
 
-    return connected_; 
+    return active_station_ == this && state_ == ConnectionState::connected;
 }
 
 
 void WiFiStation::stopConnecting( void ){
-    if( one_instance_connecting_ && connected_station_ == this ){
-        
-        one_instance_connecting_ = false;
-        connected_station_ = nullptr;
-        connected_ = false;
-        one_instance_connected_ = false;
-
-        stopConnectionCheck();
-        cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
+    TRACE_RECORD( LinkTrace::Type::stop_connecting, 0 );
+
+    cyw43_arch_lwip_begin();
 
+    if( active_station_ == this && state_ != ConnectionState::idle && state_ != ConnectionState::connected ){
+        transition( ConnectionState::idle, TransitionCause::request );
     }
+
+    cyw43_arch_lwip_end();
 }
 
 #ifdef USE_POLLING
-void WiFiStation::poll( void ){
+uint64_t WiFiStation::poll( void ){
+    if( init_stage_ == InitStage::driver ){
+        advanceInitialise();
+    }
+
     cyw43_arch_poll();
 
+    if( scan_pending_ && !cyw43_wifi_scan_active( &cyw43_state ) ){
+        finishScan();
+    }
+
     // Check if check is active and timeout passed
-    if( check_connection_ && last_connection_check_ + connection_check_interval_us < time_us_64() ){
+    const uint64_t now = time_us_64();
+    if( now >= nextConnectionCheck() ){
         checkConnection();
-        last_connection_check_ = time_us_64();
+        last_connection_check_ = now;
     }
     
     #ifdef USE_WATCHDOG
     updateWatchdog();
     #endif
 
+    next_deadline_ = nextConnectionCheck();
+    return next_deadline_;
+}
+
+
+uint64_t WiFiStation::pollBlocking( const uint64_t max_wait_us ){
+    #ifdef USE_WATCHDOG
+    // Longer waits would let the watchdog expire
+    const uint64_t latest = time_us_64() + std::min( max_wait_us, max_poll_wait_us );
+    #else
+    const uint64_t latest = time_us_64() + max_wait_us;
+    #endif
+
+    // Returns early when the driver signals work
+    cyw43_arch_wait_for_work_until( from_us_since_boot( std::min( next_deadline_, latest ) ) );
+
+    return poll();
 }
 
 #endif
@@ -334,21 +598,184 @@ int WiFiStation::scanResult( void *available_wifis_void_ptr, const cyw43_ev_scan
     vector<cyw43_ev_scan_result_t>* available_wifis = static_cast<vector<cyw43_ev_scan_result_t>*>( available_wifis_void_ptr );
 
     if( result == nullptr) return 0;
+
+    #ifdef USE_TRACE
+    uint8_t trace_data[8];
+    memcpy( trace_data, result->bssid, sizeof( result->bssid ) );
+    trace_data[6] = static_cast<uint8_t>( result->channel );
+    trace_data[7] = result->auth_mode;
+    LinkTrace::record( LinkTrace::Type::scan_result, static_cast<int8_t>( std::max<int16_t>( result->rssi, INT8_MIN ) ), trace_data, sizeof( trace_data ) );
+    #endif
+
+    const size_t capacity = available_wifis->capacity();
     available_wifis->push_back( *result );
+
+    if( available_wifis->capacity() != capacity ){
+        updateHeapPeak();
+    }
+
+    if( selector_ != nullptr ){
+        selector_->addResult( *result );
+    }
     
     
     return 0;
 }
 
 
+void WiFiStation::finishScan( void ){
+    // startJoin() reads the selector in the connection check
+    cyw43_arch_lwip_begin();
+
+    if( scan_pending_ ){
+        scan_pending_ = false;
+        TRACE_RECORD( LinkTrace::Type::scan_end, 0 );
+
+        if( selector_ != nullptr ){
+            selector_->endScan();
+        }
+    }
+
+    cyw43_arch_lwip_end();
+}
+
+
+int WiFiStation::startDriver( const uint32_t country ){
+    int return_code = cyw43_arch_init_with_country( country );
+    if( return_code != 0 ){
+        DEPUG_PRINTF( "CYW43 initialisatiion failed with %i\r\n", return_code );
+        init_stage_ = InitStage::failed;
+        return return_code;
+    }
+
+    const uint64_t now = time_us_64();
+    boot_timing_.driver_us = static_cast<uint32_t>( now - boot_timing_.started_us );
+    stage_started_ = now;
+    init_stage_ = InitStage::driver;
+
+    #ifndef USE_POLLING
+    // Remove worker if registered
+    async_context_remove_at_time_worker( cyw43_arch_async_context(), &connection_check_worker_ );
+    #endif
+
+    
+    #ifdef USE_WATCHDOG
+    if( watchdog_caused_reboot() ){
+        DEPUG_PRINTF("Rebooted by watchdog\r\n");
+    }
+    #endif
+
+    return 0;
+}
+
+
+void WiFiStation::bringUpChip( void ){
+
+    // Enter station mode. Uploads firmware on first call
+    cyw43_arch_enable_sta_mode();
+
+    heap_peak_ = heapInUse();
+
+    const uint64_t now = time_us_64();
+    boot_timing_.chip_us = static_cast<uint32_t>( now - stage_started_ );
+    stage_started_ = now;
+    init_stage_ = InitStage::chip_up;
+
+    DEPUG_PRINTF( "Chip up after %u us\r\n", static_cast<unsigned int>( now - boot_timing_.started_us ) );
+}
+
+
+void WiFiStation::advanceInitialise( void ){
+    bringUpChip();
+
+    if( init_station_ == nullptr )
+        return;
+
+    if( init_station_->connect() != 0 ){
+        init_stage_ = InitStage::failed;
+        return;
+    }
+
+    // Stage is advanced by state transitions
+    if( init_stage_ == InitStage::chip_up ){
+        init_stage_ = InitStage::connecting;
+    }
+}
+
+
+void WiFiStation::recordBootStage( const ConnectionState next, const uint64_t now ){
+
+    if( init_stage_ != InitStage::connecting && !( init_stage_ == InitStage::chip_up && init_station_ != nullptr ) )
+        return;
+
+    if( next == ConnectionState::no_ip && boot_timing_.association_us == 0 ){
+        boot_timing_.association_us = static_cast<uint32_t>( now - stage_started_ );
+        stage_started_ = now;
+    }
+    else if( next == ConnectionState::connected ){
+        // Association and IP can be seen in the same check
+        if( boot_timing_.association_us == 0 ){
+            boot_timing_.association_us = static_cast<uint32_t>( now - stage_started_ );
+        }
+        else{
+            boot_timing_.dhcp_us = static_cast<uint32_t>( now - stage_started_ );
+        }
+
+        boot_timing_.total_us = static_cast<uint32_t>( now - boot_timing_.started_us );
+        init_stage_ = InitStage::connected;
+        init_station_ = nullptr;
+
+        DEPUG_PRINTF( "Boot to IP %u us. Driver %u us, chip %u us, association %u us, DHCP %u us\r\n",
+                      static_cast<unsigned int>( boot_timing_.total_us ), static_cast<unsigned int>( boot_timing_.driver_us ),
+                      static_cast<unsigned int>( boot_timing_.chip_us ), static_cast<unsigned int>( boot_timing_.association_us ),
+                      static_cast<unsigned int>( boot_timing_.dhcp_us ) );
+    }
+}
+
+
+size_t WiFiStation::heapInUse( void ){
+    size_t bytes = available_wifis_.capacity() * sizeof( cyw43_ev_scan_result_t ) +
+                   link_listeners_.capacity() * sizeof( link_listener_t );
+
+    // Short strings are stored inside the object
+    if( active_station_ != nullptr ){
+        for( const string* const text : { &active_station_->ssid_, &active_station_->password_ } ){
+            const char* const object = reinterpret_cast<const char*>( text );
+            if( text->data() < object || text->data() >= object + sizeof( string ) ){
+                bytes += text->capacity() + 1;
+            }
+        }
+    }
+
+    return bytes;
+}
+
+
+void WiFiStation::updateHeapPeak( void ){
+    const size_t bytes = heapInUse();
+    if( bytes > heap_peak_ ){
+        heap_peak_ = bytes;
+    }
+}
+
+
+void WiFiStation::notifyLink( const bool link_up ){
+    for( const auto& listener : link_listeners_ ){
+        listener.callback( listener.user_data, link_up );
+    }
+}
+
+
 bool WiFiStation::startConnectionCheck( const uint64_t interval ){
     stopConnectionCheck();
 
     #ifdef USE_POLLING
         check_connection_ = true;
+        next_deadline_ = 0;
         return true;
     #else
-        return add_repeating_timer_ms( interval / 1000, checkConnection, nullptr, &connection_check_timer_ );
+        connection_check_worker_.do_work = connectionCheckWork;
+        return async_context_add_at_time_worker_in_ms( cyw43_arch_async_context(), &connection_check_worker_, interval / 1000 );
     #endif
     
 }
@@ -359,43 +786,42 @@ bool WiFiStation::stopConnectionCheck( void ){
         check_connection_ = false;
         return true;
     #else
-        return cancel_repeating_timer( &connection_check_timer_ );
+        return async_context_remove_at_time_worker( cyw43_arch_async_context(), &connection_check_worker_ );
     #endif
     
 }
 
-bool WiFiStation::checkConnection( 
-    #ifdef USE_POLLING
-        void
-    #else
-        repeating_timer_t* timer 
-    #endif
-){
 
-    // No station connected or connection -> leave but keep timer running
-    if( connected_station_ == nullptr ){
-        return true;
+#ifndef USE_POLLING
+void WiFiStation::connectionCheckWork( async_context_t* context, async_at_time_worker_t* worker ){
+    // Finish the scan before a join reads the selector
+    if( scan_pending_ && !cyw43_wifi_scan_active( &cyw43_state ) ){
+        finishScan();
     }
 
-    // Get current status
-    int connection_status = cyw43_tcpip_link_status( &cyw43_state, CYW43_ITF_STA );
+    checkConnection();
 
-    // Check if still connected
-    if( !one_instance_connecting_ && connected_station_->connected_ && 
-        connection_status != CYW43_LINK_UP && connection_status != CYW43_LINK_NOIP ){
-        
-        // Previously a station was connected. Not anymore
-        DEPUG_PRINTF( "Connection lost!\r\n" );
-        connected_station_->connected_ = false;
-        one_instance_connecting_ = true;
+    // Worker is removed before it runs. Add again while the state machine is active or a scan has to be finished
+    if( state_ != ConnectionState::idle || scan_pending_ ){
+        async_context_add_at_time_worker_in_ms( context, worker, checkIntervalUs() / 1000 );
+    }
+}
+#endif
+
+
+bool WiFiStation::checkConnection( void ){
 
-        // Restart check with longer interval
-        startConnectionCheck( 4 * connection_check_interval_us );
+    // No station connecting or connected -> leave but keep check running
+    if( active_station_ == nullptr || state_ == ConnectionState::idle ){
+        return true;
     }
 
+    // Get current status
+    const int connection_status = cyw43_tcpip_link_status( &cyw43_state, CYW43_ITF_STA );
+    TRACE_CHECK( connection_status );
 
     // Print status change
-    if( connection_status != last_connection_state_ ){
+    if( connection_status != link_status_ ){
         // Check state
         switch( connection_status ){
             
@@ -422,16 +848,214 @@ bool WiFiStation::checkConnection(
     }
 
     // Save current connection status
-    connected_station_->last_connection_state_ = connection_status;
+    link_status_ = connection_status;
 
+    // Next state from link status
+    if( connection_status >= CYW43_LINK_BADAUTH && connection_status <= CYW43_LINK_UP ){
+        const ConnectionState next = transition_table_[static_cast<size_t>( state_ )][connection_status - CYW43_LINK_BADAUTH];
 
-    // One station trying to connect and link is up
-    if( one_instance_connecting_ && connection_status == CYW43_LINK_UP ){
-        one_instance_connected_ = true;
-        one_instance_connecting_ = false;
-        connected_station_->connected_ = true;            
-        startConnectionCheck();
+        if( next != state_ ){
+            transition( next, TransitionCause::link_status );
+        }
+    }
+
+    // Escalate when deadline of state passed
+    const uint64_t timeout = stateTimeoutUs();
+    if( timeout > 0 && time_us_64() - state_entered_ >= timeout ){
+        escalate();
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+
+void WiFiStation::transition( const ConnectionState next, const TransitionCause cause ){
+
+    const ConnectionState previous = state_;
+
+    // Record
+    const transition_t record{ time_us_64(), previous, next, cause, static_cast<int8_t>( link_status_ ) };
+    transitions_[transition_count_ % transition_trace_size] = record;
+    transition_count_++;
+
+    state_ = next;
+    state_entered_ = record.time_us;
+
+    recordBootStage( next, record.time_us );
+
+    #ifdef USE_TRACE
+    const uint8_t trace_data[] = { static_cast<uint8_t>( previous ), static_cast<uint8_t>( cause ) };
+    LinkTrace::record( LinkTrace::Type::transition, static_cast<int8_t>( next ), trace_data, sizeof( trace_data ) );
+    #endif
+
+    switch( next ){
+
+        case ConnectionState::idle:
+            // Join was cancelled. Says nothing about the access point
+            join_reported_ = true;
+            stopConnectionCheck();
+            cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
+            active_station_ = nullptr;
+        break;
+
+        case ConnectionState::connected:
+            reportJoin( true );
+            backoff_ms_ = backoff_initial_ms_;
+        break;
+
+        case ConnectionState::backoff:
+            reportJoin( false );
+            // Leave so the driver stops retrying on its own
+            cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
+            current_backoff_ms_ = backoff_ms_;
+            backoff_ms_ = std::min( backoff_ms_ * 2, backoff_maximum_ms_ );
+        break;
+
+        default: break;
+    }
+
+    if( next == ConnectionState::backoff ){
+        DEPUG_PRINTF( "State %s -> %s for %u ms\r\n", stateName( previous ), stateName( next ), static_cast<unsigned int>( current_backoff_ms_ ) );
+    }
+    else{
+        DEPUG_PRINTF( "State %s -> %s\r\n", stateName( previous ), stateName( next ) );
+    }
+
+    if( transition_callback_ != nullptr ){
+        transition_callback_( transition_user_data_, record );
+    }
+
+    // Link callbacks
+    if( previous == ConnectionState::connected && next != ConnectionState::connected ){
+        if( next != ConnectionState::idle ){
+            DEPUG_PRINTF( "Connection lost!\r\n" );
+        }
+        notifyLink( false );
+    }
+    else if( previous != ConnectionState::connected && next == ConnectionState::connected ){
+        notifyLink( true );
+    }
+}
+
+
+void WiFiStation::escalate( void ){
+
+    switch( state_table_[static_cast<size_t>( state_ )].escalation ){
+
+        case Escalation::rejoin:
+            DEPUG_PRINTF( "No IP for too long. Rejoining\r\n" );
+            transition( startJoin() == 0 ? ConnectionState::joining : ConnectionState::backoff, TransitionCause::timeout );
+        break;
+
+        case Escalation::backoff:
+            DEPUG_PRINTF( "Join timed out\r\n" );
+            transition( ConnectionState::backoff, TransitionCause::timeout );
+        break;
+
+        case Escalation::join:
+            transition( startJoin() == 0 ? ConnectionState::joining : ConnectionState::backoff, TransitionCause::timeout );
+        break;
+
+        default: break;
+    }
+}
+
+
+int WiFiStation::startJoin( void ){
+
+    if( active_station_ == nullptr )
+        return -1;
+
+    // Password is checked in connect()
+    const char* password = active_station_->authentification_ != CYW43_AUTH_OPEN ? active_station_->password_.c_str() : nullptr;
+
+    DEPUG_PRINTF("Connecting...\r\n");
+
+    // Rejoin after previous join got no IP
+    reportJoin( false );
+
+    // Force leave of wifi before connecting to new
+    cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
+
+    // Best access point of the network known to the selector. Otherwise the firmware picks one
+    const AccessPointSelector::Candidate* const candidate = selector_ != nullptr ?
+        selector_->best( active_station_->ssid_, active_station_->authentification_ ) : nullptr;
+
+    // Try to connect non blocking
+    int connection_status = 0;
+    if( candidate != nullptr ){
+        memcpy( join_bssid_, candidate->bssid, sizeof( join_bssid_ ) );
+        join_reported_ = false;
+
+        connection_status = cyw43_arch_wifi_connect_bssid_async(   active_station_->ssid_.c_str(), 
+                                                                    join_bssid_,
+                                                                    password, 
+                                                                    active_station_->authentification_ );
+    }
+    else{
+        connection_status = cyw43_arch_wifi_connect_async(  active_station_->ssid_.c_str(), 
+                                                            password, 
+                                                            active_station_->authentification_ );
+    }
+
+    if( connection_status != 0 ){
+        DEPUG_PRINTF( "Could not start to connect. Error %i\r\n", connection_status );
+        reportJoin( false );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void WiFiStation::reportJoin( const bool success ){
+    if( join_reported_ )
+        return;
+
+    join_reported_ = true;
+
+    if( selector_ != nullptr ){
+        selector_->reportConnectResult( join_bssid_, success );
+    }
+}
+
+
+uint64_t WiFiStation::checkIntervalUs( void ){
+    // Notice association and IP early
+    if( state_ == ConnectionState::joining || state_ == ConnectionState::no_ip ){
+        return join_check_interval_us;
+    }
+
+    return connection_check_interval_us;
+}
+
+
+uint64_t WiFiStation::stateTimeoutUs( void ){
+    if( state_ == ConnectionState::backoff ){
+        return static_cast<uint64_t>( current_backoff_ms_ ) * 1000;
+    }
+
+    const state_config_t& state = state_table_[static_cast<size_t>( state_ )];
+    if( state.escalation == Escalation::none )
+        return 0;
+
+    return static_cast<uint64_t>( state.timeout_ms ) * 1000;
+}
+
+
+#ifdef USE_POLLING
+uint64_t WiFiStation::nextConnectionCheck( void ){
+    if( !check_connection_ )
+        return UINT64_MAX;
+
+    uint64_t next = last_connection_check_ + checkIntervalUs();
+
+    // Escalate on time instead of up to one interval late
+    const uint64_t timeout = stateTimeoutUs();
+    if( timeout > 0 ){
+        next = std::min( next, state_entered_ + timeout );
+    }
+
+    return next;
+}
+#endif
@@ -0,0 +1,157 @@
+/*!
+ * @file wiFiTrace.cpp
+ * @author janwolzenburg
+ * @brief Implementation of LinkTrace
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "wiFiTrace.h"
+
+
+LinkTrace::record_t LinkTrace::records_[size] = {};
+size_t LinkTrace::next_ = 0;
+size_t LinkTrace::count_ = 0;
+uint32_t LinkTrace::dropped_ = 0;
+size_t LinkTrace::last_check_ = size;
+
+
+void LinkTrace::record( const Type type, const int8_t value, const void* const data, const size_t data_size ){
+    const uint64_t now = time_us_64();
+    const uint32_t interrupts = save_and_disable_interrupts();
+
+    record_t& entry = append( now );
+    entry.type = type;
+    entry.value = value;
+    if( data != nullptr ){
+        memcpy( entry.data, data, data_size < sizeof( entry.data ) ? data_size : sizeof( entry.data ) );
+    }
+
+    restore_interrupts( interrupts );
+}
+
+
+void LinkTrace::recordCheck( const int link_status ){
+    const uint64_t now = time_us_64();
+    const uint32_t interrupts = save_and_disable_interrupts();
+
+    // Extend last record when it is the check with the same status
+    if( last_check_ < size && last_check_ == ( next_ + size - 1 ) % size && records_[last_check_].value == link_status ){
+        record_t& entry = records_[last_check_];
+
+        uint32_t checks;
+        memcpy( &checks, &entry.data[0], sizeof( checks ) );
+        checks++;
+        memcpy( &entry.data[0], &checks, sizeof( checks ) );
+
+        const uint64_t since_first = ( now - entry.time() ) / 1000;
+        const uint32_t since_first_ms = since_first > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>( since_first );
+        memcpy( &entry.data[4], &since_first_ms, sizeof( since_first_ms ) );
+    }
+    else{
+        record_t& entry = append( now );
+        entry.type = Type::check;
+        entry.value = static_cast<int8_t>( link_status );
+
+        const uint32_t checks = 1;
+        memcpy( &entry.data[0], &checks, sizeof( checks ) );
+
+        last_check_ = ( next_ + size - 1 ) % size;
+    }
+
+    restore_interrupts( interrupts );
+}
+
+
+size_t LinkTrace::count( void ){
+    return count_;
+}
+
+
+size_t LinkTrace::copy( record_t* const records, const size_t max_count ){
+    if( records == nullptr )
+        return 0;
+
+    const uint32_t interrupts = save_and_disable_interrupts();
+
+    const size_t copied = count_ < max_count ? count_ : max_count;
+    const size_t first = ( next_ + size - count_ ) % size;
+
+    for( size_t i = 0; i < copied; i++ ){
+        records[i] = records_[( first + i ) % size];
+    }
+
+    restore_interrupts( interrupts );
+
+    return copied;
+}
+
+
+void LinkTrace::dump( void ){
+
+    // Snapshot of ring position. Records added while printing may overwrite the oldest ones
+    uint32_t interrupts = save_and_disable_interrupts();
+    const size_t records = count_;
+    const size_t first = ( next_ + size - count_ ) % size;
+    const uint32_t dropped = dropped_;
+    restore_interrupts( interrupts );
+
+    printf( "TRACE begin %u %u\r\n", static_cast<unsigned int>( records ), static_cast<unsigned int>( dropped ) );
+
+    for( size_t i = 0; i < records; i++ ){
+        interrupts = save_and_disable_interrupts();
+        const record_t entry = records_[( first + i ) % size];
+        restore_interrupts( interrupts );
+
+        const uint8_t* const bytes = reinterpret_cast<const uint8_t*>( &entry );
+
+        printf( "TRACE " );
+        for( size_t byte = 0; byte < sizeof( record_t ); byte++ ){
+            printf( "%02x", bytes[byte] );
+        }
+        printf( "\r\n" );
+    }
+
+    printf( "TRACE end\r\n" );
+}
+
+
+void LinkTrace::clear( void ){
+    const uint32_t interrupts = save_and_disable_interrupts();
+
+    next_ = 0;
+    count_ = 0;
+    dropped_ = 0;
+    last_check_ = size;
+
+    restore_interrupts( interrupts );
+}
+
+
+LinkTrace::record_t& LinkTrace::append( const uint64_t time ){
+    record_t& entry = records_[next_];
+
+    if( count_ < size ){
+        count_++;
+    }
+    else{
+        dropped_++;
+    }
+
+    if( last_check_ == next_ ){
+        last_check_ = size;
+    }
+
+    next_ = ( next_ + 1 ) % size;
+
+    entry = record_t{};
+    entry.time_low = static_cast<uint32_t>( time );
+    entry.time_high = static_cast<uint16_t>( time >> 32 );
+
+    return entry;
+}
@@ -0,0 +1,383 @@
+/*!
+ * @file wiFiTransport.cpp
+ * @author janwolzenburg
+ * @brief Implementation of lwIP transport helpers
+ * @version 1.0
+ * @date 2024-03-18
+ *
+ */
+
+#include "wiFiTransport.h"
+
+
+UdpEndpoint::UdpEndpoint( void ) :
+    pcb_( nullptr ),
+    receive_handler_( nullptr ),
+    user_data_( nullptr ),
+    send_counters_{}
+{}
+
+
+UdpEndpoint::~UdpEndpoint( void ){
+    close();
+}
+
+
+int UdpEndpoint::open( const uint16_t local_port ){
+
+    close();
+
+    LwipLock lock;
+
+    pcb_ = udp_new();
+    if( pcb_ == nullptr ){
+        return ERR_MEM;
+    }
+
+    const err_t error = udp_bind( pcb_, IP_ADDR_ANY, local_port );
+    if( error != ERR_OK ){
+        udp_remove( pcb_ );
+        pcb_ = nullptr;
+        return error;
+    }
+
+    udp_recv( pcb_, received, this );
+
+    return 0;
+}
+
+
+void UdpEndpoint::close( void ){
+
+    if( pcb_ == nullptr )
+        return;
+
+    LwipLock lock;
+    udp_remove( pcb_ );
+    pcb_ = nullptr;
+}
+
+
+void UdpEndpoint::setReceiveHandler( const receive_handler_t handler, void* user_data ){
+    LwipLock lock;
+    receive_handler_ = handler;
+    user_data_ = user_data;
+}
+
+
+int UdpEndpoint::sendTo( const void* data, const uint16_t length, const ip_addr_t& address, const uint16_t port ){
+    return sendReference( data, length, PBUF_REF, address, port );
+}
+
+
+int UdpEndpoint::sendConstant( const void* data, const uint16_t length, const ip_addr_t& address, const uint16_t port ){
+    return sendReference( data, length, PBUF_ROM, address, port );
+}
+
+
+int UdpEndpoint::sendTo( struct pbuf* chain, const ip_addr_t& address, const uint16_t port ){
+
+    if( pcb_ == nullptr || chain == nullptr )
+        return ERR_ARG;
+
+    LwipLock lock;
+
+    // lwIP adds and removes the headers in place. Chain stays owned by caller
+    const err_t error = udp_sendto( pcb_, chain, &address, port );
+
+    send_counters_.sends++;
+    if( error != ERR_OK ) send_counters_.failures++;
+
+    return error;
+}
+
+
+struct pbuf* UdpEndpoint::allocate( const uint16_t length ){
+    LwipLock lock;
+    return pbuf_alloc( PBUF_TRANSPORT, length, PBUF_POOL );
+}
+
+
+void UdpEndpoint::release( struct pbuf* chain ){
+    if( chain == nullptr )
+        return;
+
+    LwipLock lock;
+    pbuf_free( chain );
+}
+
+
+int UdpEndpoint::sendReference( const void* data, const uint16_t length, const pbuf_type type, const ip_addr_t& address, const uint16_t port ){
+
+    if( pcb_ == nullptr || data == nullptr )
+        return ERR_ARG;
+
+    LwipLock lock;
+
+    // Only the pbuf header is allocated. Payload points to caller's buffer
+    send_counters_.sends++;
+
+    struct pbuf* reference = pbuf_alloc( PBUF_TRANSPORT, length, type );
+    if( reference == nullptr ){
+        send_counters_.failures++;
+        return ERR_MEM;
+    }
+
+    reference->payload = const_cast<void*>( data );
+
+    const err_t error = udp_sendto( pcb_, reference, &address, port );
+    pbuf_free( reference );
+
+    if( error != ERR_OK ) send_counters_.failures++;
+
+    return error;
+}
+
+
+void UdpEndpoint::received( void* argument, struct udp_pcb* pcb, struct pbuf* chain, const ip_addr_t* address, uint16_t port ){
+    UdpEndpoint* endpoint = static_cast<UdpEndpoint*>( argument );
+
+    if( endpoint == nullptr || endpoint->receive_handler_ == nullptr ){
+        pbuf_free( chain );
+        return;
+    }
+
+    // Ownership passes to the handler
+    endpoint->receive_handler_( endpoint->user_data_, chain, address, port );
+}
+
+
+
+TcpConnection::TcpConnection( void ) :
+    pcb_( nullptr ),
+    connected_( false ),
+    aborted_( false ),
+    receive_handler_( nullptr ),
+    sent_handler_( nullptr ),
+    state_handler_( nullptr ),
+    user_data_( nullptr ),
+    send_counters_{}
+{}
+
+
+TcpConnection::~TcpConnection( void ){
+    // Nobody may be notified from a destructed instance
+    state_handler_ = nullptr;
+    abort();
+}
+
+
+void TcpConnection::setHandlers( const receive_handler_t receive_handler, const sent_handler_t sent_handler,
+                                 const state_handler_t state_handler, void* user_data ){
+    LwipLock lock;
+    receive_handler_ = receive_handler;
+    sent_handler_ = sent_handler;
+    state_handler_ = state_handler;
+    user_data_ = user_data;
+}
+
+
+int TcpConnection::connect( const ip_addr_t& address, const uint16_t port ){
+
+    if( pcb_ != nullptr )
+        return ERR_ISCONN;
+
+    LwipLock lock;
+
+    pcb_ = tcp_new();
+    if( pcb_ == nullptr ){
+        return ERR_MEM;
+    }
+
+    tcp_arg( pcb_, this );
+    tcp_recv( pcb_, receivedCallback );
+    tcp_sent( pcb_, sentCallback );
+    tcp_err( pcb_, errorCallback );
+
+    const err_t error = tcp_connect( pcb_, &address, port, connectedCallback );
+    if( error != ERR_OK ){
+        struct tcp_pcb* pcb = pcb_;
+        detach();
+        tcp_abort( pcb );
+        return error;
+    }
+
+    return 0;
+}
+
+
+int TcpConnection::write( const void* data, const uint16_t length, const bool more ){
+    return enqueue( data, length, more ? TCP_WRITE_FLAG_MORE : 0 );
+}
+
+
+int TcpConnection::writeCopy( const void* data, const uint16_t length, const bool more ){
+    return enqueue( data, length, TCP_WRITE_FLAG_COPY | ( more ? TCP_WRITE_FLAG_MORE : 0 ) );
+}
+
+
+int TcpConnection::flush( void ){
+
+    if( !connected_ )
+        return ERR_CONN;
+
+    LwipLock lock;
+    const err_t error = tcp_output( pcb_ );
+
+    // A flush is no send of its own
+    if( error != ERR_OK ) send_counters_.flush_failures++;
+
+    return error;
+}
+
+
+uint16_t TcpConnection::sendBufferSpace( void ) const{
+
+    if( !connected_ )
+        return 0;
+
+    LwipLock lock;
+    return tcp_sndbuf( pcb_ );
+}
+
+
+void TcpConnection::close( void ){
+
+    if( pcb_ == nullptr )
+        return;
+
+    LwipLock lock;
+
+    struct tcp_pcb* pcb = pcb_;
+    detach();
+
+    if( tcp_close( pcb ) != ERR_OK ){
+        tcp_abort( pcb );
+    }
+
+    notifyState( false, ERR_CLSD );
+}
+
+
+void TcpConnection::abort( void ){
+
+    if( pcb_ == nullptr )
+        return;
+
+    LwipLock lock;
+
+    struct tcp_pcb* pcb = pcb_;
+    detach();
+    tcp_abort( pcb );
+    aborted_ = true;
+
+    notifyState( false, ERR_ABRT );
+}
+
+
+int TcpConnection::enqueue( const void* data, const uint16_t length, const uint8_t flags ){
+
+    if( !connected_ )
+        return ERR_CONN;
+
+    LwipLock lock;
+    const err_t error = tcp_write( pcb_, data, length, flags );
+
+    send_counters_.sends++;
+    if( error != ERR_OK ) send_counters_.failures++;
+
+    return error;
+}
+
+
+void TcpConnection::detach( void ){
+
+    if( pcb_ != nullptr ){
+        tcp_arg( pcb_, nullptr );
+        tcp_recv( pcb_, nullptr );
+        tcp_sent( pcb_, nullptr );
+        tcp_err( pcb_, nullptr );
+    }
+
+    pcb_ = nullptr;
+    connected_ = false;
+}
+
+
+void TcpConnection::notifyState( const bool connected, const err_t error ){
+    if( state_handler_ != nullptr ){
+        state_handler_( user_data_, connected, error );
+    }
+}
+
+
+err_t TcpConnection::connectedCallback( void* argument, struct tcp_pcb* pcb, err_t error ){
+    TcpConnection* connection = static_cast<TcpConnection*>( argument );
+    if( connection == nullptr ) return ERR_OK;
+
+    connection->connected_ = ( error == ERR_OK );
+    connection->notifyState( connection->connected_, error );
+
+    return ERR_OK;
+}
+
+
+err_t TcpConnection::receivedCallback( void* argument, struct tcp_pcb* pcb, struct pbuf* chain, err_t error ){
+    TcpConnection* connection = static_cast<TcpConnection*>( argument );
+
+    // Remote closed
+    if( chain == nullptr ){
+        if( connection != nullptr ){
+            connection->detach();
+            connection->notifyState( false, ERR_CLSD );
+        }
+
+        if( tcp_close( pcb ) != ERR_OK ){
+            tcp_abort( pcb );
+            return ERR_ABRT;
+        }
+        return ERR_OK;
+    }
+
+    // Data belongs to the handler from now on. Updating the window first also keeps a close in the handler
+    // from resetting the connection because of unacknowledged data
+    tcp_recved( pcb, chain->tot_len );
+
+    // Ownership passes to the handler
+    if( connection != nullptr && connection->receive_handler_ != nullptr && error == ERR_OK ){
+        connection->aborted_ = false;
+        connection->receive_handler_( connection->user_data_, chain );
+
+        // Only an aborted pcb may be reported to lwIP. A closed one is still finished by lwIP
+        if( connection->aborted_ ){
+            return ERR_ABRT;
+        }
+    }
+    else{
+        pbuf_free( chain );
+    }
+
+    return ERR_OK;
+}
+
+
+err_t TcpConnection::sentCallback( void* argument, struct tcp_pcb* pcb, uint16_t length ){
+    TcpConnection* connection = static_cast<TcpConnection*>( argument );
+
+    if( connection != nullptr && connection->sent_handler_ != nullptr ){
+        connection->sent_handler_( connection->user_data_, length );
+    }
+
+    return ERR_OK;
+}
+
+
+void TcpConnection::errorCallback( void* argument, err_t error ){
+    TcpConnection* connection = static_cast<TcpConnection*>( argument );
+    if( connection == nullptr ) return;
+
+    // pcb is already freed by lwIP
+    connection->pcb_ = nullptr;
+    connection->connected_ = false;
+    connection->notifyState( false, error );
+}
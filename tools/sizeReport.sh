@@ -0,0 +1,40 @@
+#!/bin/sh
+# Static flash and RAM cost per feature flag
+# Builds the example once per variant and prints one line of key=value pairs for the image and every library object.
+# Needs PICO_SDK_PATH and arm-none-eabi-size.
+#
+# Usage: tools/sizeReport.sh [build directory]
+
+set -e
+
+SOURCE_DIR=$( cd "$( dirname "$0" )/.." && pwd )
+BUILD_DIR=${1:-$SOURCE_DIR/build_size}
+SIZE=${SIZE:-arm-none-eabi-size}
+
+BASE="-Duse_polling=ON -Duse_watchdog=OFF -Duse_trace=OFF -Duse_lwip_memory_stats=OFF"
+
+# Flash is text and data, RAM is data and bss
+print_size(){
+    $SIZE "$2" | awk -v variant="$1" -v object="$( basename "$2" )" \
+        'NR == 2 { printf "variant=%s object=%s text=%d data=%d bss=%d flash=%d ram=%d\n", variant, object, $1, $2, $3, $1 + $2, $2 + $3 }'
+}
+
+report(){
+    variant=$1
+    shift
+    directory="$BUILD_DIR/$variant"
+
+    cmake -S "$SOURCE_DIR" -B "$directory" $BASE "$@" > /dev/null
+    cmake --build "$directory" --target piPicoWiFiStation -j > /dev/null
+
+    print_size "$variant" "$directory/piPicoWiFiStation.elf"
+    for object in "$directory"/CMakeFiles/piPicoWiFiStation.dir/src/*.o*; do
+        print_size "$variant" "$object"
+    done
+}
+
+report baseline
+report background -Duse_polling=OFF
+report watchdog -Duse_watchdog=ON
+report trace -Duse_trace=ON
+report lwip_memory_stats -Duse_lwip_memory_stats=ON